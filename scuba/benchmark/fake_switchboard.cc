@@ -0,0 +1,67 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/benchmark/fake_switchboard.h"
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/switchboard.ad.h"
+
+using arpc::FileDescriptor;
+using arpc::ServerContext;
+using arpc::Status;
+using flower::protocol::switchboard::ConstrainRequest;
+using flower::protocol::switchboard::ConstrainResponse;
+using flower::protocol::switchboard::ServerStartRequest;
+using flower::protocol::switchboard::ServerStartResponse;
+using flower::protocol::switchboard::Switchboard;
+using scuba::benchmark::FakeSwitchboard;
+
+namespace {
+
+std::pair<std::shared_ptr<FileDescriptor>, std::shared_ptr<FileDescriptor>>
+CreateSocketPair() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    throw std::system_error(errno, std::system_category(),
+                            "Failed to create socket pair");
+  return {std::make_shared<FileDescriptor>(fds[0]),
+          std::make_shared<FileDescriptor>(fds[1])};
+}
+
+}  // namespace
+
+Status FakeSwitchboard::Constrain(ServerContext* context,
+                                  const ConstrainRequest* request,
+                                  ConstrainResponse* response) {
+  response->set_switchboard(CreateSocketPair().first);
+  return Status::OK;
+}
+
+Status FakeSwitchboard::ServerStart(ServerContext* context,
+                                    const ServerStartRequest* request,
+                                    ServerStartResponse* response) {
+  response->set_server(CreateSocketPair().first);
+  return Status::OK;
+}
+
+std::unique_ptr<Switchboard::Stub> FakeSwitchboard::Start() {
+  auto fds = CreateSocketPair();
+  std::thread([this, server_fd{fds.first}]() {
+    arpc::ServerBuilder builder(server_fd);
+    builder.RegisterService(this);
+    std::unique_ptr<arpc::Server> server(builder.Build());
+    while (server->HandleRequest() == 0) {
+    }
+  })
+      .detach();
+  return Switchboard::NewStub(arpc::CreateChannel(fds.second));
+}
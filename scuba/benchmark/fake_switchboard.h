@@ -0,0 +1,45 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_BENCHMARK_FAKE_SWITCHBOARD_H
+#define SCUBA_BENCHMARK_FAKE_SWITCHBOARD_H
+
+#include <memory>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/switchboard.ad.h"
+
+namespace scuba {
+namespace benchmark {
+
+// Switchboard that grants every request, handing out connections that
+// have no other end. Allows the services to be exercised without
+// running Flower.
+class FakeSwitchboard final
+    : public flower::protocol::switchboard::Switchboard::Service {
+ public:
+  FakeSwitchboard() = default;
+
+  arpc::Status Constrain(
+      arpc::ServerContext* context,
+      const flower::protocol::switchboard::ConstrainRequest* request,
+      flower::protocol::switchboard::ConstrainResponse* response);
+  arpc::Status ServerStart(
+      arpc::ServerContext* context,
+      const flower::protocol::switchboard::ServerStartRequest* request,
+      flower::protocol::switchboard::ServerStartResponse* response);
+
+  // Serves the switchboard on a background thread, returning a stub
+  // that is connected to it.
+  std::unique_ptr<flower::protocol::switchboard::Switchboard::Stub> Start();
+
+ private:
+  FakeSwitchboard(FakeSwitchboard&) = delete;
+  void operator=(FakeSwitchboard) = delete;
+};
+
+}  // namespace benchmark
+}  // namespace scuba
+
+#endif
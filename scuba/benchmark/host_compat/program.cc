@@ -0,0 +1,46 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <program.h>
+#include <unistd.h>
+#include <uv.h>
+
+#include <cerrno>
+
+namespace {
+
+char* default_spawn_command[] = {const_cast<char*>("true"), nullptr};
+char** spawn_command = default_spawn_command;
+
+}  // namespace
+
+DIR* opendirat(int fd, const char* path) {
+  int dirfd = openat(fd, path, O_RDONLY | O_DIRECTORY);
+  if (dirfd < 0)
+    return nullptr;
+  DIR* directory = fdopendir(dirfd);
+  if (directory == nullptr) {
+    int error = errno;
+    close(dirfd);
+    errno = error;
+  }
+  return directory;
+}
+
+int program_spawn(uv_loop_t* loop, uv_process_t* handle, int fd,
+                  const argdata_t* ad, uv_exit_cb exit_cb) {
+  uv_process_options_t options = {};
+  options.exit_cb = exit_cb;
+  options.file = spawn_command[0];
+  options.args = spawn_command;
+  // libuv returns negated error numbers, whereas program_spawn()
+  // returns them as is.
+  return -uv_spawn(loop, handle, &options);
+}
+
+void scuba_benchmark_set_spawn_command(char** argv) {
+  spawn_command = argv;
+}
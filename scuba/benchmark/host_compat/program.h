@@ -0,0 +1,40 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_BENCHMARK_HOST_COMPAT_PROGRAM_H
+#define SCUBA_BENCHMARK_HOST_COMPAT_PROGRAM_H
+
+// Replacements for CloudABI-specific interfaces used by the services,
+// allowing them to be built and benchmarked on the host system.
+
+#include <argdata.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <uv.h>
+
+#ifndef O_EXEC
+#define O_EXEC O_RDONLY
+#endif
+#ifndef O_SEARCH
+#define O_SEARCH O_RDONLY
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DIR* opendirat(int fd, const char* path);
+
+// Instead of spawning the executable with the Argdata provided, spawns
+// the command set through scuba_benchmark_set_spawn_command().
+int program_spawn(uv_loop_t* loop, uv_process_t* handle, int fd,
+                  const argdata_t* ad, uv_exit_cb exit_cb);
+
+void scuba_benchmark_set_spawn_command(char** argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
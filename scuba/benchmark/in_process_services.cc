@@ -0,0 +1,93 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/benchmark/in_process_services.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "arpc++/arpc++.h"
+#include "grpc++/grpc++.h"
+
+using arpc::FileDescriptor;
+using scuba::benchmark::InProcessServices;
+
+namespace {
+
+FileDescriptor OpenDirectory(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), path);
+  return FileDescriptor(fd);
+}
+
+// Strips leading slashes, as the services interpret absolute paths
+// relative to their root directory.
+std::string_view MakeRelative(std::string_view path) {
+  while (!path.empty() && path.front() == '/')
+    path.remove_prefix(1);
+  return path;
+}
+
+}  // namespace
+
+InProcessServices::InProcessServices()
+    : scratch_directory_(CreateScratchDirectory_()),
+      root_directory_(OpenDirectory(scratch_directory_ / "root")),
+      image_directory_(OpenDirectory(scratch_directory_ / "images")),
+      switchboard_stub_(switchboard_.Start()),
+      event_log_(4096),
+      runtime_service_(&root_directory_, &image_directory_,
+                       switchboard_stub_.get(), &ip_address_allocator_,
+                       &event_log_, nullptr, nullptr, nullptr, nullptr),
+      image_service_(&image_directory_, nullptr, nullptr) {
+  grpc::ServerBuilder builder;
+  builder.RegisterService(&runtime_service_);
+  builder.RegisterService(&image_service_);
+  server_ = builder.BuildAndStart();
+  if (!server_)
+    throw std::runtime_error("Failed to start GRPC server");
+}
+
+InProcessServices::~InProcessServices() {
+  server_->Shutdown();
+  std::filesystem::remove_all(scratch_directory_);
+}
+
+void InProcessServices::CreateImage(std::string_view name) {
+  std::filesystem::path path =
+      scratch_directory_ / "images" / MakeRelative(name);
+  std::filesystem::create_directories(path.parent_path());
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY, 0755);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), path);
+  close(fd);
+}
+
+void InProcessServices::CreateDirectory(std::string_view path) {
+  std::filesystem::create_directories(scratch_directory_ / "root" /
+                                      MakeRelative(path));
+}
+
+std::shared_ptr<grpc::Channel> InProcessServices::GetChannel() {
+  return server_->InProcessChannel(grpc::ChannelArguments());
+}
+
+std::filesystem::path InProcessServices::CreateScratchDirectory_() {
+  char path[] = "/tmp/scuba-benchmark.XXXXXX";
+  if (mkdtemp(path) == nullptr)
+    throw std::system_error(errno, std::system_category(), "mkdtemp");
+  std::filesystem::create_directory(std::filesystem::path(path) / "root");
+  std::filesystem::create_directory(std::filesystem::path(path) / "images");
+  return path;
+}
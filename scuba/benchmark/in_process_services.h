@@ -0,0 +1,62 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_BENCHMARK_IN_PROCESS_SERVICES_H
+#define SCUBA_BENCHMARK_IN_PROCESS_SERVICES_H
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/switchboard.ad.h"
+#include "grpc++/grpc++.h"
+#include "scuba/benchmark/fake_switchboard.h"
+#include "scuba/image_service/image_service.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/ip_address_allocator.h"
+#include "scuba/runtime_service/runtime_service.h"
+
+namespace scuba {
+namespace benchmark {
+
+// Runtime and image services running in the current process, connected
+// to a fake switchboard. Their root and image directories are stored in
+// a scratch directory that is removed afterwards.
+class InProcessServices {
+ public:
+  InProcessServices();
+  ~InProcessServices();
+
+  // Creates an empty image, or a directory within the root directory,
+  // so that requests referring to them can be processed.
+  void CreateImage(std::string_view name);
+  void CreateDirectory(std::string_view path);
+
+  std::shared_ptr<grpc::Channel> GetChannel();
+
+ private:
+  static std::filesystem::path CreateScratchDirectory_();
+
+  const std::filesystem::path scratch_directory_;
+  const arpc::FileDescriptor root_directory_;
+  const arpc::FileDescriptor image_directory_;
+
+  FakeSwitchboard switchboard_;
+  const std::unique_ptr<flower::protocol::switchboard::Switchboard::Stub>
+      switchboard_stub_;
+  runtime_service::IPAddressAllocator ip_address_allocator_;
+  runtime_service::EventLog event_log_;
+  runtime_service::RuntimeService runtime_service_;
+  image_service::ImageService image_service_;
+  std::unique_ptr<grpc::Server> server_;
+
+  InProcessServices(InProcessServices&) = delete;
+  void operator=(InProcessServices) = delete;
+};
+
+}  // namespace benchmark
+}  // namespace scuba
+
+#endif
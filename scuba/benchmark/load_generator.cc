@@ -0,0 +1,488 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+// Load generator for the CRI services. Runs the runtime and image
+// services in-process on the host system against a fake switchboard,
+// spawning trivial host processes instead of CloudABI executables. It
+// drives them with a mix of pod churn, relisting and status polling at
+// target rates, followed by draining a large number of pods at once.
+// Throughput and latency percentiles are reported per RPC.
+
+#include <getopt.h>
+#include <program.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "grpc++/grpc++.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.grpc.pb.h"
+#include "scuba/benchmark/in_process_services.h"
+
+using grpc::ClientContext;
+using grpc::Status;
+using runtime::ContainerConfig;
+using runtime::PodSandboxConfig;
+using scuba::benchmark::InProcessServices;
+
+namespace {
+
+struct Options {
+  std::chrono::duration<double> duration{10};
+  unsigned int threads = 8;
+  double pod_rate = 20;
+  unsigned int live_pods = 100;
+  unsigned int containers_per_pod = 1;
+  double list_rate = 10;
+  double status_rate = 100;
+  unsigned int drain_pods = 500;
+};
+
+// Latencies and error counts of calls, grouped by RPC name.
+class LatencyRecorder {
+ public:
+  template <typename Call>
+  Status Measure(const char* name, Call call) {
+    auto start = std::chrono::steady_clock::now();
+    Status status = call();
+    auto latency = std::chrono::steady_clock::now() - start;
+
+    std::unique_lock lock(lock_);
+    Calls& calls = calls_[name];
+    calls.latencies.push_back(latency);
+    if (!status.ok()) {
+      if (calls.errors++ == 0)
+        calls.first_error = status.error_message();
+    }
+    return status;
+  }
+
+  void Clear() {
+    std::unique_lock lock(lock_);
+    calls_.clear();
+  }
+
+  void Report(std::chrono::duration<double> elapsed) {
+    std::unique_lock lock(lock_);
+    std::cout << std::left << std::setw(20) << "RPC" << std::right
+              << std::setw(9) << "Calls" << std::setw(8) << "Errors"
+              << std::setw(10) << "Calls/s" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+              << std::setw(10) << "max us" << std::endl;
+    for (auto& rpc : calls_) {
+      auto& latencies = rpc.second.latencies;
+      std::sort(latencies.begin(), latencies.end());
+      auto percentile = [&latencies](double p) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   latencies[std::size_t(p * (latencies.size() - 1))])
+            .count();
+      };
+      std::cout << std::left << std::setw(20) << rpc.first << std::right
+                << std::setw(9) << latencies.size() << std::setw(8)
+                << rpc.second.errors << std::setw(10) << std::fixed
+                << std::setprecision(1) << latencies.size() / elapsed.count()
+                << std::setw(10) << percentile(0.5) << std::setw(10)
+                << percentile(0.9) << std::setw(10) << percentile(0.99)
+                << std::setw(10) << percentile(1.0) << std::endl;
+    }
+    for (const auto& rpc : calls_)
+      if (rpc.second.errors > 0)
+        std::cout << rpc.first << ": " << rpc.second.first_error << std::endl;
+  }
+
+ private:
+  struct Calls {
+    std::vector<std::chrono::steady_clock::duration> latencies;
+    std::size_t errors = 0;
+    std::string first_error;
+  };
+
+  std::mutex lock_;
+  std::map<std::string, Calls> calls_;
+};
+
+struct Pod {
+  std::string pod_sandbox_id;
+  std::vector<std::string> container_ids;
+};
+
+// Client that issues requests against the services and records their
+// latency.
+class CRIClient {
+ public:
+  CRIClient(const std::shared_ptr<grpc::Channel>& channel,
+            const Options& options, LatencyRecorder* recorder)
+      : runtime_service_(runtime::RuntimeService::NewStub(channel)),
+        image_service_(runtime::ImageService::NewStub(channel)),
+        options_(options),
+        recorder_(recorder),
+        next_pod_(0) {
+  }
+
+  void UpdateRuntimeConfig(const std::string& pod_cidr) {
+    runtime::UpdateRuntimeConfigRequest request;
+    request.mutable_runtime_config()->mutable_network_config()->set_pod_cidr(
+        pod_cidr);
+    runtime::UpdateRuntimeConfigResponse response;
+    Call("UpdateRuntimeConfig", &runtime::RuntimeService::Stub::
+                                    UpdateRuntimeConfig,
+         request, &response);
+  }
+
+  // Creates a pod sandbox and starts its containers.
+  std::optional<Pod> CreatePod() {
+    std::uint64_t number = next_pod_++;
+    std::string pod_name = "pod-" + std::to_string(number);
+    runtime::RunPodSandboxRequest run_request;
+    PodSandboxConfig* pod_config = run_request.mutable_config();
+    pod_config->mutable_metadata()->set_name(pod_name);
+    pod_config->mutable_metadata()->set_uid("uid-" + std::to_string(number));
+    pod_config->mutable_metadata()->set_namespace_("benchmark");
+    pod_config->set_log_directory("logs");
+    (*pod_config->mutable_labels())["app"] = "benchmark";
+    runtime::RunPodSandboxResponse run_response;
+    if (!Call("RunPodSandbox", &runtime::RuntimeService::Stub::RunPodSandbox,
+              run_request, &run_response)
+             .ok())
+      return {};
+
+    Pod pod;
+    pod.pod_sandbox_id = run_response.pod_sandbox_id();
+    for (unsigned int i = 0; i < options_.containers_per_pod; ++i) {
+      std::string container_name = "container-" + std::to_string(i);
+      runtime::CreateContainerRequest create_request;
+      create_request.set_pod_sandbox_id(pod.pod_sandbox_id);
+      ContainerConfig* config = create_request.mutable_config();
+      config->mutable_metadata()->set_name(container_name);
+      config->mutable_image()->set_image("benchmark");
+      config->set_log_path(pod_name + "_" + container_name + ".log");
+      config->set_argdata("{}");
+      (*config->mutable_labels())["container"] = container_name;
+      *create_request.mutable_sandbox_config() = *pod_config;
+      runtime::CreateContainerResponse create_response;
+      if (!Call("CreateContainer",
+                &runtime::RuntimeService::Stub::CreateContainer,
+                create_request, &create_response)
+               .ok())
+        continue;
+
+      runtime::StartContainerRequest start_request;
+      start_request.set_container_id(create_response.container_id());
+      runtime::StartContainerResponse start_response;
+      Call("StartContainer", &runtime::RuntimeService::Stub::StartContainer,
+           start_request, &start_response);
+      pod.container_ids.push_back(create_response.container_id());
+    }
+    return pod;
+  }
+
+  void StopPod(const Pod& pod) {
+    runtime::StopPodSandboxRequest request;
+    request.set_pod_sandbox_id(pod.pod_sandbox_id);
+    runtime::StopPodSandboxResponse response;
+    Call("StopPodSandbox", &runtime::RuntimeService::Stub::StopPodSandbox,
+         request, &response);
+  }
+
+  void RemovePod(const Pod& pod) {
+    runtime::RemovePodSandboxRequest request;
+    request.set_pod_sandbox_id(pod.pod_sandbox_id);
+    runtime::RemovePodSandboxResponse response;
+    Call("RemovePodSandbox", &runtime::RuntimeService::Stub::RemovePodSandbox,
+         request, &response);
+  }
+
+  // Relists all objects, like the kubelet's pod lifecycle event
+  // generator does periodically.
+  void Relist() {
+    runtime::ListPodSandboxRequest pod_request;
+    runtime::ListPodSandboxResponse pod_response;
+    Call("ListPodSandbox", &runtime::RuntimeService::Stub::ListPodSandbox,
+         pod_request, &pod_response);
+    runtime::ListContainersRequest container_request;
+    runtime::ListContainersResponse container_response;
+    Call("ListContainers", &runtime::RuntimeService::Stub::ListContainers,
+         container_request, &container_response);
+    runtime::ListImagesRequest image_request;
+    runtime::ListImagesResponse image_response;
+    Call("ListImages", &runtime::ImageService::Stub::ListImages,
+         image_service_.get(), image_request, &image_response);
+  }
+
+  void PollStatus(const Pod& pod) {
+    runtime::PodSandboxStatusRequest pod_request;
+    pod_request.set_pod_sandbox_id(pod.pod_sandbox_id);
+    runtime::PodSandboxStatusResponse pod_response;
+    Call("PodSandboxStatus", &runtime::RuntimeService::Stub::PodSandboxStatus,
+         pod_request, &pod_response);
+    for (const std::string& container_id : pod.container_ids) {
+      runtime::ContainerStatusRequest container_request;
+      container_request.set_container_id(container_id);
+      runtime::ContainerStatusResponse container_response;
+      Call("ContainerStatus", &runtime::RuntimeService::Stub::ContainerStatus,
+           container_request, &container_response);
+    }
+  }
+
+ private:
+  template <typename Stub, typename Request, typename Response>
+  Status Call(const char* name,
+              Status (Stub::*method)(ClientContext*, const Request&,
+                                     Response*),
+              Stub* stub, const Request& request, Response* response) {
+    return recorder_->Measure(name, [&]() {
+      ClientContext context;
+      return (stub->*method)(&context, request, response);
+    });
+  }
+
+  template <typename Request, typename Response>
+  Status Call(const char* name,
+              Status (runtime::RuntimeService::Stub::*method)(
+                  ClientContext*, const Request&, Response*),
+              const Request& request, Response* response) {
+    return Call(name, method, runtime_service_.get(), request, response);
+  }
+
+  const std::unique_ptr<runtime::RuntimeService::Stub> runtime_service_;
+  const std::unique_ptr<runtime::ImageService::Stub> image_service_;
+  const Options& options_;
+  LatencyRecorder* const recorder_;
+  std::atomic<std::uint64_t> next_pod_;
+};
+
+// Pods that have been created during the churn phase and not yet
+// removed, used as the targets of status polling.
+class LivePods {
+ public:
+  // Adds a pod, returning the oldest pod if the limit has been reached.
+  std::optional<Pod> Push(Pod pod, std::size_t limit) {
+    std::unique_lock lock(lock_);
+    pods_.push_back(std::move(pod));
+    if (pods_.size() <= limit)
+      return {};
+    Pod oldest = std::move(pods_.front());
+    pods_.pop_front();
+    return oldest;
+  }
+
+  std::optional<Pod> GetRandom(std::mt19937* random) {
+    std::unique_lock lock(lock_);
+    if (pods_.empty())
+      return {};
+    return pods_[(*random)() % pods_.size()];
+  }
+
+  std::deque<Pod> TakeAll() {
+    std::unique_lock lock(lock_);
+    return std::move(pods_);
+  }
+
+ private:
+  std::mutex lock_;
+  std::deque<Pod> pods_;
+};
+
+// Invokes a function at a target rate, spread out over a number of
+// threads, until a deadline has passed. Threads that fall behind don't
+// attempt to catch up, so that the achieved rate can be observed.
+template <typename Function>
+std::vector<std::thread> RunAtRate(
+    double rate, unsigned int threads,
+    std::chrono::steady_clock::time_point deadline, Function function) {
+  std::vector<std::thread> workers;
+  if (rate <= 0)
+    return workers;
+  auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(threads / rate));
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers.emplace_back([=]() {
+      std::mt19937 random(i);
+      for (auto next = start + interval * i / threads;
+           next < deadline; next += interval) {
+        std::this_thread::sleep_until(next);
+        function(&random);
+        next = std::max(next, std::chrono::steady_clock::now() - interval);
+      }
+    });
+  }
+  return workers;
+}
+
+// Invokes a function for every element of a list, spread out over a
+// number of threads.
+template <typename T, typename Function>
+void RunInParallel(std::vector<T>* elements, unsigned int threads,
+                   Function function) {
+  std::atomic<std::size_t> next_element(0);
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      for (std::size_t index = next_element++; index < elements->size();
+           index = next_element++)
+        function(&(*elements)[index]);
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void Usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " [--duration=seconds] [--threads=n] [--pod_rate=per_second]"
+               " [--live_pods=n] [--containers_per_pod=n]"
+               " [--list_rate=per_second] [--status_rate=per_second]"
+               " [--drain_pods=n] [-- command ...]"
+            << std::endl;
+  std::exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  static const struct option long_options[] = {
+      {"duration", required_argument, nullptr, 'd'},
+      {"threads", required_argument, nullptr, 't'},
+      {"pod_rate", required_argument, nullptr, 'p'},
+      {"live_pods", required_argument, nullptr, 'l'},
+      {"containers_per_pod", required_argument, nullptr, 'c'},
+      {"list_rate", required_argument, nullptr, 'r'},
+      {"status_rate", required_argument, nullptr, 's'},
+      {"drain_pods", required_argument, nullptr, 'D'},
+      {nullptr, 0, nullptr, 0},
+  };
+  for (int c; (c = getopt_long(argc, argv, "", long_options, nullptr)) != -1;) {
+    switch (c) {
+      case 'd':
+        options.duration = std::chrono::duration<double>(std::atof(optarg));
+        break;
+      case 't':
+        options.threads = std::max(1, std::atoi(optarg));
+        break;
+      case 'p':
+        options.pod_rate = std::atof(optarg);
+        break;
+      case 'l':
+        options.live_pods = std::atoi(optarg);
+        break;
+      case 'c':
+        options.containers_per_pod = std::atoi(optarg);
+        break;
+      case 'r':
+        options.list_rate = std::atof(optarg);
+        break;
+      case 's':
+        options.status_rate = std::atof(optarg);
+        break;
+      case 'D':
+        options.drain_pods = std::atoi(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  // Containers run a long-lived process by default, so that stopping
+  // pod sandboxes needs to terminate them.
+  static char* default_command[] = {const_cast<char*>("sleep"),
+                                    const_cast<char*>("3600"), nullptr};
+  scuba_benchmark_set_spawn_command(optind < argc ? argv + optind
+                                                  : default_command);
+
+  // Start the services, connected through an in-process channel.
+  InProcessServices services;
+  services.CreateImage("benchmark");
+  services.CreateDirectory("logs");
+
+  LatencyRecorder recorder;
+  CRIClient client(services.GetChannel(), options, &recorder);
+  client.UpdateRuntimeConfig("10.0.0.0/8");
+
+  // Phase 1: steady churn of pods, mixed with relisting and polling.
+  std::cout << "Churn: " << options.pod_rate << " pods/s, "
+            << options.live_pods << " live pods, " << options.list_rate
+            << " relists/s, " << options.status_rate << " status polls/s"
+            << std::endl;
+  LivePods live_pods;
+  recorder.Clear();
+  auto start = std::chrono::steady_clock::now();
+  auto deadline =
+      start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  options.duration);
+  std::vector<std::thread> workers = RunAtRate(
+      options.pod_rate, options.threads, deadline, [&](std::mt19937* random) {
+        std::optional<Pod> pod = client.CreatePod();
+        if (!pod)
+          return;
+        std::optional<Pod> oldest =
+            live_pods.Push(std::move(*pod), options.live_pods);
+        if (oldest) {
+          client.StopPod(*oldest);
+          client.RemovePod(*oldest);
+        }
+      });
+  for (auto& worker :
+       RunAtRate(options.list_rate, options.threads, deadline,
+                 [&](std::mt19937* random) { client.Relist(); }))
+    workers.push_back(std::move(worker));
+  for (auto& worker : RunAtRate(options.status_rate, options.threads,
+                                deadline, [&](std::mt19937* random) {
+                                  std::optional<Pod> pod =
+                                      live_pods.GetRandom(random);
+                                  if (pod)
+                                    client.PollStatus(*pod);
+                                }))
+    workers.push_back(std::move(worker));
+  for (auto& worker : workers)
+    worker.join();
+  recorder.Report(std::chrono::steady_clock::now() - start);
+
+  std::deque<Pod> remaining_pods = live_pods.TakeAll();
+  std::vector<Pod> cleanup(remaining_pods.begin(), remaining_pods.end());
+  RunInParallel(&cleanup, options.threads, [&client](Pod* pod) {
+    client.StopPod(*pod);
+    client.RemovePod(*pod);
+  });
+
+  // Phase 2: create a large number of pods and drain them all at once,
+  // like what happens when a node is being drained.
+  if (options.drain_pods > 0) {
+    std::cout << std::endl
+              << "Drain: " << options.drain_pods << " pods" << std::endl;
+    std::vector<Pod> pods(options.drain_pods);
+    RunInParallel(&pods, options.threads, [&client](Pod* pod) {
+      if (std::optional<Pod> created = client.CreatePod(); created)
+        *pod = std::move(*created);
+    });
+
+    recorder.Clear();
+    start = std::chrono::steady_clock::now();
+    RunInParallel(&pods, options.threads, [&client](Pod* pod) {
+      client.StopPod(*pod);
+      client.RemovePod(*pod);
+    });
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    recorder.Report(elapsed);
+    std::cout << "Drained in " << elapsed.count() << " s" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,572 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+// Microbenchmarks of operations that are performed on every call to the
+// runtime service or on every line of output of a container.
+
+#include <argdata.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <openssl/sha.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "argdata.hpp"
+#include "arpc++/arpc++.h"
+#include "benchmark/benchmark.h"
+#include "flower/protocol/switchboard.ad.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/benchmark/fake_switchboard.h"
+#include "scuba/image_service/chunk_store.h"
+#include "scuba/runtime_service/binary_argdata.h"
+#include "scuba/runtime_service/container.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/ip_address_allocator.h"
+#include "scuba/runtime_service/iso8601_timestamp.h"
+#include "scuba/runtime_service/log_framer.h"
+#include "scuba/runtime_service/naming_scheme.h"
+#include "scuba/runtime_service/pod_sandbox.h"
+#include "scuba/runtime_service/server_switchboard.h"
+#include "scuba/runtime_service/state_journal.h"
+#include "scuba/runtime_service/yaml_file_descriptor_factory.h"
+#include "scuba/util/stream_relay.h"
+#include "yaml2argdata/yaml_argdata_factory.h"
+#include "yaml2argdata/yaml_builder.h"
+#include "yaml2argdata/yaml_canonicalizing_factory.h"
+#include "yaml2argdata/yaml_error_factory.h"
+
+using arpc::FileDescriptor;
+using flower::protocol::switchboard::Switchboard;
+using google::protobuf::Map;
+using runtime::ContainerConfig;
+using runtime::ContainerMetadata;
+using runtime::PodSandboxConfig;
+using runtime::PodSandboxMetadata;
+using runtime::PodSandboxState;
+using scuba::benchmark::FakeSwitchboard;
+using scuba::image_service::ChunkStore;
+using scuba::journal::Record;
+using scuba::runtime_service::BinaryArgdata;
+using scuba::runtime_service::ConstrainServerSwitchboard;
+using scuba::runtime_service::Container;
+using scuba::runtime_service::EventLog;
+using scuba::runtime_service::IPAddressAllocator;
+using scuba::runtime_service::IPAddressLease;
+using scuba::runtime_service::ISO8601Timestamp;
+using scuba::runtime_service::LogFramer;
+using scuba::runtime_service::NamingScheme;
+using scuba::runtime_service::PodSandbox;
+using scuba::runtime_service::StateJournal;
+using scuba::runtime_service::ToJournalTime;
+using scuba::runtime_service::YAMLFileDescriptorFactory;
+using scuba::util::RelayStreams;
+using yaml2argdata::YAMLArgdataFactory;
+using yaml2argdata::YAMLBuilder;
+using yaml2argdata::YAMLCanonicalizingFactory;
+using yaml2argdata::YAMLErrorFactory;
+
+namespace {
+
+// Temporary directory that is removed when going out of scope.
+class ScratchDirectory {
+ public:
+  ScratchDirectory() {
+    char path[] = "/tmp/scuba-benchmark.XXXXXX";
+    if (mkdtemp(path) == nullptr)
+      throw std::system_error(errno, std::system_category(), "mkdtemp");
+    path_ = path;
+    fd_ = std::make_unique<FileDescriptor>(
+        open(path, O_RDONLY | O_DIRECTORY));
+  }
+
+  ~ScratchDirectory() {
+    std::filesystem::remove_all(path_);
+  }
+
+  const FileDescriptor* GetFileDescriptor() const {
+    return fd_.get();
+  }
+
+ private:
+  std::filesystem::path path_;
+  std::unique_ptr<FileDescriptor> fd_;
+};
+
+void BM_ComposePodSandboxContainerName(benchmark::State& state) {
+  std::string pod_sandbox_id = "1f6c9cdb04e7a8d2";
+  std::string container_id = "9b0e5a3c7d12f486";
+  for (auto _ : state)
+    benchmark::DoNotOptimize(NamingScheme::ComposePodSandboxContainerName(
+        pod_sandbox_id, container_id));
+}
+BENCHMARK(BM_ComposePodSandboxContainerName);
+
+void BM_DecomposePodSandboxContainerName(benchmark::State& state) {
+  std::string name = NamingScheme::ComposePodSandboxContainerName(
+      "1f6c9cdb04e7a8d2", "9b0e5a3c7d12f486");
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        NamingScheme::DecomposePodSandboxContainerName(name));
+}
+BENCHMARK(BM_DecomposePodSandboxContainerName);
+
+// Looks up a container by the name provided in a request, in a pod
+// sandbox having a given number of containers.
+void BM_PodSandboxContainerLookup(benchmark::State& state) {
+  PodSandboxConfig config;
+  config.mutable_metadata()->set_name("pod");
+  EventLog event_log(16);
+  PodSandbox pod_sandbox("1f6c9cdb04e7a8d2", config,
+                         std::chrono::system_clock::now(), IPAddressLease(),
+                         &event_log, nullptr, nullptr, nullptr, nullptr);
+
+  std::vector<std::string> names;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    Record record;
+    auto created = record.mutable_container_created();
+    created->mutable_config()->mutable_metadata()->set_name(
+        "container-" + std::to_string(i));
+    created->set_container_id(
+        NamingScheme::CreateContainerName(created->config().metadata()));
+    pod_sandbox.RestoreContainer(record);
+    names.push_back(NamingScheme::ComposePodSandboxContainerName(
+        pod_sandbox.GetId(), created->container_id()));
+  }
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    auto ids = NamingScheme::DecomposePodSandboxContainerName(
+        names[i++ % names.size()]);
+    benchmark::DoNotOptimize(pod_sandbox.GetContainerOutput(ids.second));
+  }
+}
+BENCHMARK(BM_PodSandboxContainerLookup)->Arg(1)->Arg(16)->Arg(256);
+
+// Matches a label selector of a given size against a pod sandbox
+// having a given number of labels, all of which match.
+void BM_PodSandboxMatchesFilter(benchmark::State& state) {
+  PodSandboxConfig config;
+  config.mutable_metadata()->set_name("pod");
+  for (std::int64_t i = 0; i < state.range(0); ++i)
+    (*config.mutable_labels())["label-" + std::to_string(i)] =
+        "value-" + std::to_string(i);
+  EventLog event_log(16);
+  PodSandbox pod_sandbox("1f6c9cdb04e7a8d2", config,
+                         std::chrono::system_clock::now(), IPAddressLease(),
+                         &event_log, nullptr, nullptr, nullptr, nullptr);
+
+  Map<std::string, std::string> selector;
+  for (std::int64_t i = 0; i < state.range(1); ++i)
+    selector["label-" + std::to_string(i)] = "value-" + std::to_string(i);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(pod_sandbox.MatchesFilter(
+        PodSandboxState::SANDBOX_READY, selector));
+}
+BENCHMARK(BM_PodSandboxMatchesFilter)
+    ->Args({0, 0})
+    ->Args({8, 0})
+    ->Args({8, 1})
+    ->Args({8, 4})
+    ->Args({32, 8});
+
+// Creates containers with the configuration that the kubelet generates
+// for replicas of a single deployment, reporting the amount of memory
+// used per container.
+void BM_ContainerMemory(benchmark::State& state) {
+  ContainerConfig config;
+  config.mutable_metadata()->set_name("server");
+  config.mutable_image()->set_image("nuxi.nl/server:1.2.3");
+  auto& labels = *config.mutable_labels();
+  labels["io.kubernetes.container.name"] = "server";
+  labels["io.kubernetes.pod.namespace"] = "production";
+  auto& annotations = *config.mutable_annotations();
+  annotations["io.kubernetes.container.hash"] = "5f6d3b1c";
+  annotations["io.kubernetes.container.restartCount"] = "0";
+  annotations["io.kubernetes.container.terminationMessagePath"] =
+      "/dev/termination-log";
+  annotations["io.kubernetes.container.terminationMessagePolicy"] = "File";
+  annotations["io.kubernetes.pod.terminationGracePeriod"] = "30";
+  std::string argdata = "%TAG ! tag:nuxi.nl,2015:cloudabi/\n---\n";
+  for (int i = 0; i < 32; ++i)
+    argdata += "option_" + std::to_string(i) + ": value_" + std::to_string(i) +
+               "\n";
+  config.set_argdata(argdata);
+  EventLog event_log(16);
+
+  for (auto _ : state) {
+    std::vector<std::unique_ptr<Container>> containers;
+    containers.reserve(state.range(0));
+    std::size_t before = mallinfo2().uordblks;
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+      // Fields that differ between replicas.
+      std::string pod = "server-5f6d3b1c-" + std::to_string(i);
+      labels["io.kubernetes.pod.name"] = pod;
+      labels["io.kubernetes.pod.uid"] = "uid-" + std::to_string(i);
+      config.clear_mounts();
+      runtime::Mount* mount = config.add_mounts();
+      mount->set_container_path("/etc/config");
+      mount->set_host_path("/var/lib/kubelet/pods/uid-" + std::to_string(i) +
+                           "/volumes/config");
+      mount->set_readonly(true);
+      config.set_log_path("server/0.log");
+      containers.push_back(std::make_unique<Container>(
+          pod, "server", config, std::chrono::system_clock::now(), &event_log,
+          nullptr));
+    }
+    state.counters["bytes_per_container"] =
+        double(mallinfo2().uordblks - before) / state.range(0);
+  }
+}
+BENCHMARK(BM_ContainerMemory)
+    ->Arg(10000)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+// Allocates and deallocates an address in a /16, while a percentage of
+// the range is already in use.
+void BM_IPAddressAllocator(benchmark::State& state) {
+  IPAddressAllocator allocator;
+  allocator.SetRange("10.0.0.0/16");
+  std::vector<IPAddressLease> leases;
+  std::size_t in_use = 65534 * state.range(0) / 100;
+  for (std::size_t i = 0; i < in_use; ++i)
+    leases.push_back(allocator.Allocate());
+
+  for (auto _ : state) {
+    IPAddressLease lease = allocator.Allocate();
+    benchmark::DoNotOptimize(lease.GetAddress());
+  }
+}
+BENCHMARK(BM_IPAddressAllocator)->Arg(0)->Arg(50)->Arg(90)->Arg(99);
+
+void BM_ISO8601Timestamp(benchmark::State& state) {
+  std::ostringstream output;
+  for (auto _ : state) {
+    output.seekp(0);
+    output << ISO8601Timestamp();
+  }
+}
+BENCHMARK(BM_ISO8601Timestamp);
+
+// Frames a chunk of output consisting of lines of a given length.
+void BM_LogFramer(benchmark::State& state) {
+  std::string line(state.range(0) - 1, 'x');
+  line += '\n';
+  std::string chunk;
+  while (chunk.size() + line.size() <= 4096)
+    chunk += line;
+
+  std::ostringstream output;
+  LogFramer framer(&output, LogFramer::kDefaultMaxLineLength);
+  for (auto _ : state) {
+    output.seekp(0);
+    framer.Write(chunk);
+  }
+  state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(BM_LogFramer)->Arg(16)->Arg(128)->Arg(1024)->Arg(4096);
+
+// Converts the Argdata of a container from YAML, using the same chain
+// of factories as containers do when they are started.
+void BM_YAMLToArgdata(benchmark::State& state, const char* yaml) {
+  PodSandboxMetadata pod_metadata;
+  pod_metadata.set_name("pod");
+  pod_metadata.set_namespace_("default");
+  ContainerMetadata container_metadata;
+  container_metadata.set_name("container");
+  FileDescriptor container_log(open("/dev/null", O_WRONLY));
+  std::map<std::string, FileDescriptor, std::less<>> mounts;
+  mounts.emplace("data", open("/", O_RDONLY | O_DIRECTORY));
+  // The switchboard keeps on serving in the background, so it must
+  // outlive the benchmark.
+  static FakeSwitchboard switchboard;
+  static std::unique_ptr<Switchboard::Stub> switchboard_stub =
+      switchboard.Start();
+
+  for (auto _ : state) {
+    YAMLErrorFactory<const argdata_t*> error_factory;
+    YAMLFileDescriptorFactory file_descriptor_factory(
+        &pod_metadata, &container_metadata, &container_log, &mounts,
+        switchboard_stub.get(), &error_factory);
+    YAMLArgdataFactory argdata_factory(&file_descriptor_factory);
+    YAMLCanonicalizingFactory<const argdata_t*> canonicalizing_factory(
+        &argdata_factory);
+    YAMLBuilder<const argdata_t*> builder(&canonicalizing_factory);
+    std::istringstream input(yaml);
+    benchmark::DoNotOptimize(builder.Build(&input));
+  }
+}
+BENCHMARK_CAPTURE(BM_YAMLToArgdata, minimal, "{}");
+BENCHMARK_CAPTURE(BM_YAMLToArgdata, web_server,
+                  "%TAG ! tag:nuxi.nl,2015:cloudabi/\n"
+                  "---\n"
+                  "logfile: !kubernetes/container_log\n"
+                  "data: !kubernetes/mount data\n"
+                  "http: !kubernetes/server\n"
+                  "  protocol: http\n"
+                  "  port: 80\n"
+                  "threads: 8\n"
+                  "hostnames: [example.com, www.example.com]\n");
+BENCHMARK_CAPTURE(BM_YAMLToArgdata, large_configuration,
+                  "%TAG ! tag:nuxi.nl,2015:cloudabi/\n"
+                  "---\n"
+                  "logfile: !kubernetes/container_log\n"
+                  "data: !kubernetes/mount data\n"
+                  "routes:\n"
+                  "  - {path: /api/v1, backend: api, timeout: 30}\n"
+                  "  - {path: /api/v2, backend: api2, timeout: 30}\n"
+                  "  - {path: /static, backend: files, timeout: 5}\n"
+                  "  - {path: /metrics, backend: metrics, timeout: 1}\n"
+                  "limits:\n"
+                  "  connections: 1024\n"
+                  "  request_size: 1048576\n"
+                  "  header_size: 8192\n"
+                  "tls:\n"
+                  "  ciphers: [ECDHE-ECDSA-AES128-GCM-SHA256, "
+                  "ECDHE-RSA-AES128-GCM-SHA256]\n"
+                  "  session_cache: true\n");
+
+// Decodes the same Argdata as the web_server case of BM_YAMLToArgdata,
+// provided in its binary encoding instead.
+void BM_BinaryArgdata(benchmark::State& state) {
+  PodSandboxMetadata pod_metadata;
+  pod_metadata.set_name("pod");
+  pod_metadata.set_namespace_("default");
+  ContainerMetadata container_metadata;
+  container_metadata.set_name("container");
+  FileDescriptor container_log(open("/dev/null", O_WRONLY));
+  std::map<std::string, FileDescriptor, std::less<>> mounts;
+  mounts.emplace("data", open("/", O_RDONLY | O_DIRECTORY));
+  static FakeSwitchboard switchboard;
+  static std::unique_ptr<Switchboard::Stub> switchboard_stub =
+      switchboard.Start();
+
+  // Encode the Argdata, with the file descriptors of the container log,
+  // the mount and the server as placeholders 0, 1 and 2, respectively.
+  // Serializing the Argdata numbers file descriptors in the order in
+  // which they occur.
+  std::vector<argdata_t*> hostnames = {
+      argdata_create_str_c("example.com"),
+      argdata_create_str_c("www.example.com")};
+  std::vector<argdata_t*> keys = {
+      argdata_create_str_c("logfile"), argdata_create_str_c("data"),
+      argdata_create_str_c("http"), argdata_create_str_c("threads"),
+      argdata_create_str_c("hostnames")};
+  std::vector<argdata_t*> values = {
+      argdata_create_fd(0), argdata_create_fd(1), argdata_create_fd(2),
+      argdata_create_str_c("8"),
+      argdata_create_seq(hostnames.data(), hostnames.size())};
+  argdata_t* map = argdata_create_map(keys.data(), values.data(), keys.size());
+  std::size_t data_length, fds_length;
+  argdata_serialized_length(map, &data_length, &fds_length);
+  std::string data(data_length, '\0');
+  std::vector<int> fds(fds_length);
+  argdata_serialize(map, data.data(), fds.data());
+  argdata_free(map);
+  for (argdata_t* ad : keys)
+    argdata_free(ad);
+  for (argdata_t* ad : values)
+    argdata_free(ad);
+  for (argdata_t* ad : hostnames)
+    argdata_free(ad);
+
+  for (auto _ : state) {
+    std::vector<std::shared_ptr<FileDescriptor>> switchboards;
+    switchboards.push_back(ConstrainServerSwitchboard(
+        switchboard_stub.get(), pod_metadata, container_metadata,
+        {{"protocol", "http"}, {"port", "80"}}));
+    BinaryArgdata argdata(data, {container_log.get(),
+                                 mounts.find("data")->second.get(),
+                                 switchboards.back()->get()});
+    benchmark::DoNotOptimize(argdata.Get());
+  }
+}
+BENCHMARK(BM_BinaryArgdata);
+
+// Stores a series of versions of an executable in a chunk store, each
+// differing slightly from the previous one, reporting the fraction of
+// their total size that needed to be written to disk.
+void BM_ChunkStore(benchmark::State& state) {
+  // Successive versions have a couple of bytes patched and a couple of
+  // bytes inserted, shifting the remainder of the executable.
+  std::mt19937 generator(0);
+  std::vector<std::string> versions;
+  std::string data(4 * 1024 * 1024, '\0');
+  for (char& c : data)
+    c = generator();
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    versions.push_back(data);
+    for (int j = 0; j < 8; ++j)
+      data[generator() % data.size()] = generator();
+    data.insert(generator() % data.size(), std::string(16, char(i)));
+  }
+
+  std::uint64_t ingested = 0, stored = 0;
+  for (auto _ : state) {
+    ScratchDirectory chunk_directory;
+    ScratchDirectory image_directory;
+    ChunkStore chunk_store(chunk_directory.GetFileDescriptor());
+    for (const std::string& version : versions) {
+      unsigned char digest[SHA256_DIGEST_LENGTH];
+      SHA256(reinterpret_cast<const unsigned char*>(version.data()),
+             version.size(), digest);
+      std::ostringstream image_name;
+      image_name << "sha256:" << std::hex << std::setfill('0');
+      for (unsigned char byte : digest)
+        image_name << std::setw(2) << int(byte);
+
+      state.PauseTiming();
+      FileDescriptor image(openat(image_directory.GetFileDescriptor()->get(),
+                                  image_name.str().c_str(),
+                                  O_RDWR | O_CREAT | O_TRUNC, 0644));
+      if (write(image.get(), version.data(), version.size()) !=
+          ssize_t(version.size()))
+        throw std::system_error(errno, std::system_category(), "write");
+      lseek(image.get(), 0, SEEK_SET);
+      state.ResumeTiming();
+
+      stored += chunk_store.Ingest(image_name.str(), image.get());
+      ingested += version.size();
+    }
+  }
+  state.SetBytesProcessed(ingested);
+  state.counters["stored_fraction"] = double(stored) / ingested;
+}
+BENCHMARK(BM_ChunkStore)->Arg(2)->Arg(10)->Unit(benchmark::kMillisecond);
+
+// Replays a journal of a given number of records, like the runtime
+// service does when it is restarted.
+void BM_StateJournalReplay(benchmark::State& state) {
+  ScratchDirectory directory;
+  StateJournal journal(directory.GetFileDescriptor());
+  journal.Replay([](const Record& record) {});
+  auto now = ToJournalTime(std::chrono::system_clock::now());
+  for (std::int64_t i = 0; i < state.range(0); i += 3) {
+    std::string pod_sandbox_id = "pod-" + std::to_string(i);
+    Record pod_record;
+    auto pod_created = pod_record.mutable_pod_sandbox_created();
+    pod_created->set_pod_sandbox_id(pod_sandbox_id);
+    pod_created->mutable_config()->mutable_metadata()->set_name(pod_sandbox_id);
+    (*pod_created->mutable_config()->mutable_labels())["app"] = "benchmark";
+    pod_created->set_created_at(now);
+    journal.Append(pod_record);
+
+    Record container_record;
+    auto container_created = container_record.mutable_container_created();
+    container_created->set_pod_sandbox_id(pod_sandbox_id);
+    container_created->set_container_id("container");
+    container_created->mutable_config()->mutable_metadata()->set_name(
+        "container");
+    container_created->mutable_config()->set_argdata("{}");
+    container_created->set_created_at(now);
+    journal.Append(container_record);
+
+    Record started_record;
+    auto container_started = started_record.mutable_container_started();
+    container_started->set_pod_sandbox_id(pod_sandbox_id);
+    container_started->set_container_id("container");
+    container_started->set_started_at(now);
+    journal.Append(started_record);
+  }
+
+  for (auto _ : state) {
+    std::size_t records = 0;
+    journal.Replay([&records](const Record& record) { ++records; });
+    benchmark::DoNotOptimize(records);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StateJournalReplay)->Arg(1000)->Arg(10000);
+
+// Creates a pair of connected TCP sockets on the loopback interface.
+std::pair<FileDescriptor, FileDescriptor> CreateLoopbackConnection() {
+  FileDescriptor listener(socket(AF_INET, SOCK_STREAM, 0));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_length = sizeof(address);
+  if (bind(listener.get(), reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener.get(), 1) != 0 ||
+      getsockname(listener.get(), reinterpret_cast<sockaddr*>(&address),
+                  &address_length) != 0)
+    throw std::system_error(errno, std::system_category(), "listen");
+  FileDescriptor client(socket(AF_INET, SOCK_STREAM, 0));
+  if (connect(client.get(), reinterpret_cast<sockaddr*>(&address),
+              sizeof(address)) != 0)
+    throw std::system_error(errno, std::system_category(), "connect");
+  FileDescriptor server(accept(listener.get(), nullptr, nullptr));
+  return {std::move(client), std::move(server)};
+}
+
+// Pushes data through a given number of concurrent port forwarding
+// streams, each consisting of a client and a server connected through
+// the relay over loopback.
+void BM_RelayStreams(benchmark::State& state) {
+  constexpr std::size_t kBytesPerStream = 16 * 1024 * 1024;
+  const std::string chunk(65536, 'x');
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    // Threads reference connections, so they may not be reallocated.
+    std::vector<std::pair<FileDescriptor, FileDescriptor>> connections;
+    connections.reserve(2 * state.range(0));
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+      auto& client = connections.emplace_back(CreateLoopbackConnection());
+      auto& server = connections.emplace_back(CreateLoopbackConnection());
+      threads.emplace_back([&client, &server]() {
+        RelayStreams(client.second.get(), server.first.get());
+      });
+      threads.emplace_back([&client, &chunk]() {
+        for (std::size_t sent = 0; sent < kBytesPerStream;
+             sent += chunk.size())
+          if (write(client.first.get(), chunk.data(), chunk.size()) !=
+              ssize_t(chunk.size()))
+            break;
+        shutdown(client.first.get(), SHUT_WR);
+      });
+      threads.emplace_back([&server]() {
+        char buffer[65536];
+        while (read(server.second.get(), buffer, sizeof(buffer)) > 0) {
+        }
+        shutdown(server.second.get(), SHUT_WR);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          kBytesPerStream);
+}
+BENCHMARK(BM_RelayStreams)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(64)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
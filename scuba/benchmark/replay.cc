@@ -0,0 +1,270 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+// Replays a request log recorded by the runtime or image service
+// against a fresh instance of both services running in-process,
+// preserving the original spacing between calls, optionally sped up.
+// For every method, it reports how the latency and the resulting status
+// codes of the replayed calls diverge from the recorded ones.
+
+#include <getopt.h>
+#include <program.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "grpc++/grpc++.h"
+#include "grpcpp/generic/generic_stub.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/benchmark/in_process_services.h"
+#include "scuba/util/request_log.pb.h"
+
+using google::protobuf::io::CodedInputStream;
+using scuba::benchmark::InProcessServices;
+using scuba::request_log::Call;
+
+namespace {
+
+// Outcome of replaying a single call.
+struct Replayed {
+  std::chrono::nanoseconds latency;
+  // Time between the moment the call was due and when it was issued,
+  // caused by all threads being busy.
+  std::chrono::nanoseconds lag;
+  int status_code;
+};
+
+std::vector<Call> ReadRequestLog(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Failed to open " << path << std::endl;
+    std::exit(1);
+  }
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+
+  // Stop at the first record that cannot be parsed, as the log may end
+  // with a partially written record.
+  std::vector<Call> calls;
+  CodedInputStream input(reinterpret_cast<const std::uint8_t*>(data.data()),
+                         data.size());
+  for (std::uint32_t length; input.ReadVarint32(&length);) {
+    auto limit = input.PushLimit(length);
+    Call& call = calls.emplace_back();
+    if (!call.ParseFromCodedStream(&input) ||
+        !input.ConsumedEntireMessage()) {
+      calls.pop_back();
+      break;
+    }
+    input.PopLimit(limit);
+  }
+  std::stable_sort(calls.begin(), calls.end(),
+                   [](const Call& a, const Call& b) {
+                     return a.received_at() < b.received_at();
+                   });
+  return calls;
+}
+
+// Creates the images and directories referenced by the calls, which
+// were present on the system on which they were recorded.
+void CreateFixtures(const std::vector<Call>& calls,
+                    InProcessServices* services) {
+  for (const Call& call : calls) {
+    if (call.method() == "/runtime.RuntimeService/RunPodSandbox") {
+      runtime::RunPodSandboxRequest request;
+      if (request.ParseFromString(call.request()))
+        services->CreateDirectory(request.config().log_directory());
+    } else if (call.method() == "/runtime.RuntimeService/CreateContainer") {
+      runtime::CreateContainerRequest request;
+      if (request.ParseFromString(call.request())) {
+        services->CreateImage(request.config().image().image());
+        for (const auto& mount : request.config().mounts())
+          services->CreateDirectory(mount.host_path());
+      }
+    } else if (call.method() == "/runtime.ImageService/PullImage") {
+      runtime::PullImageRequest request;
+      if (request.ParseFromString(call.request()))
+        services->CreateImage(request.image().image());
+    }
+  }
+}
+
+// Issues a call, waiting for it to complete.
+Replayed Issue(grpc::GenericStub* stub, grpc::CompletionQueue* queue,
+               const Call& call) {
+  grpc::Slice slice(call.request());
+  grpc::ByteBuffer request(&slice, 1);
+  grpc::ByteBuffer response;
+  grpc::Status status;
+  grpc::ClientContext context;
+
+  auto start = std::chrono::steady_clock::now();
+  auto reader = stub->PrepareUnaryCall(&context, call.method(), request, queue);
+  reader->StartCall();
+  reader->Finish(&response, &status, nullptr);
+  void* tag;
+  bool ok;
+  queue->Next(&tag, &ok);
+  return {std::chrono::steady_clock::now() - start, {}, status.error_code()};
+}
+
+std::chrono::nanoseconds Percentile(std::vector<std::chrono::nanoseconds>* v,
+                                    double p) {
+  std::sort(v->begin(), v->end());
+  return (*v)[std::size_t(p * (v->size() - 1))];
+}
+
+void Report(const std::vector<Call>& calls,
+            const std::vector<Replayed>& replayed) {
+  struct Method {
+    std::vector<std::chrono::nanoseconds> recorded;
+    std::vector<std::chrono::nanoseconds> replayed;
+    std::vector<std::chrono::nanoseconds> lag;
+    std::size_t status_mismatches = 0;
+  };
+  std::map<std::string, Method> methods;
+  for (std::size_t i = 0; i < calls.size(); ++i) {
+    Method& method = methods[calls[i].method()];
+    method.recorded.push_back(std::chrono::nanoseconds(calls[i].latency()));
+    method.replayed.push_back(replayed[i].latency);
+    method.lag.push_back(replayed[i].lag);
+    if (replayed[i].status_code != calls[i].status_code())
+      ++method.status_mismatches;
+  }
+
+  auto us = [](std::chrono::nanoseconds duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+        .count();
+  };
+  std::cout << std::left << std::setw(44) << "Method" << std::right
+            << std::setw(8) << "Calls" << std::setw(12) << "Rec p50 us"
+            << std::setw(12) << "Rep p50 us" << std::setw(12) << "Rec p99 us"
+            << std::setw(12) << "Rep p99 us" << std::setw(10) << "p50 x"
+            << std::setw(12) << "Lag p99 us" << std::setw(12)
+            << "Status diff" << std::endl;
+  for (auto& [name, method] : methods) {
+    auto recorded_p50 = Percentile(&method.recorded, 0.5);
+    auto replayed_p50 = Percentile(&method.replayed, 0.5);
+    std::cout << std::left << std::setw(44) << name << std::right
+              << std::setw(8) << method.recorded.size() << std::setw(12)
+              << us(recorded_p50) << std::setw(12) << us(replayed_p50)
+              << std::setw(12) << us(Percentile(&method.recorded, 0.99))
+              << std::setw(12) << us(Percentile(&method.replayed, 0.99))
+              << std::setw(10) << std::fixed << std::setprecision(2)
+              << (recorded_p50.count() > 0
+                      ? double(replayed_p50.count()) / recorded_p50.count()
+                      : 0.0)
+              << std::setw(12) << us(Percentile(&method.lag, 0.99))
+              << std::setw(12) << method.status_mismatches << std::endl;
+  }
+}
+
+void Usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " [--speed=factor] [--threads=n] request_log [-- command ...]"
+            << std::endl;
+  std::exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  double speed = 1;
+  unsigned int threads = 16;
+  static const struct option long_options[] = {
+      {"speed", required_argument, nullptr, 's'},
+      {"threads", required_argument, nullptr, 't'},
+      {nullptr, 0, nullptr, 0},
+  };
+  for (int c; (c = getopt_long(argc, argv, "", long_options, nullptr)) != -1;) {
+    switch (c) {
+      case 's':
+        speed = std::atof(optarg);
+        break;
+      case 't':
+        threads = std::max(1, std::atoi(optarg));
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+  if (optind >= argc || speed <= 0)
+    Usage(argv[0]);
+  std::vector<Call> calls = ReadRequestLog(argv[optind++]);
+  if (calls.empty()) {
+    std::cerr << "Request log contains no calls" << std::endl;
+    return 1;
+  }
+
+  // Containers run a long-lived process by default, so that stopping
+  // them behaves like it would for actual workloads.
+  static char* default_command[] = {const_cast<char*>("sleep"),
+                                    const_cast<char*>("3600"), nullptr};
+  scuba_benchmark_set_spawn_command(optind < argc ? argv + optind
+                                                  : default_command);
+
+  InProcessServices services;
+  CreateFixtures(calls, &services);
+  std::shared_ptr<grpc::Channel> channel = services.GetChannel();
+
+  // Calls are issued in the order in which they were received. Threads
+  // pick up the next call as soon as they are idle, sleeping until the
+  // point in time at which the call is due.
+  std::vector<Replayed> replayed(calls.size());
+  std::atomic<std::size_t> next_call(0);
+  auto first_received = std::chrono::nanoseconds(calls.front().received_at());
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      grpc::GenericStub stub(channel);
+      grpc::CompletionQueue queue;
+      for (std::size_t index = next_call++; index < calls.size();
+           index = next_call++) {
+        const Call& call = calls[index];
+        auto due =
+            start +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                (std::chrono::nanoseconds(call.received_at()) -
+                 first_received) /
+                speed);
+        std::this_thread::sleep_until(due);
+        auto lag = std::chrono::steady_clock::now() - due;
+        replayed[index] = Issue(&stub, &queue, call);
+        replayed[index].lag = lag;
+      }
+      queue.Shutdown();
+      void* tag;
+      bool ok;
+      while (queue.Next(&tag, &ok)) {
+      }
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::chrono::duration<double> recorded =
+      std::chrono::nanoseconds(calls.back().received_at()) - first_received;
+  std::cout << "Replayed " << calls.size() << " calls spanning "
+            << recorded.count() << " s at " << speed << "x in "
+            << elapsed.count() << " s" << std::endl;
+  Report(calls, replayed);
+  return 0;
+}
@@ -0,0 +1,336 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/image_service/chunk_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <openssl/sha.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "arpc++/arpc++.h"
+#include "scuba/util/metrics.h"
+
+using arpc::FileDescriptor;
+using scuba::image_service::ChunkStore;
+using scuba::util::Counter;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+Counter* const ingested_bytes = MetricsRegistry::Default()->GetCounter(
+    "scuba_image_chunk_store_ingested_bytes_total",
+    "Size of images added to the chunk store.");
+Counter* const stored_bytes = MetricsRegistry::Default()->GetCounter(
+    "scuba_image_chunk_store_stored_bytes_total",
+    "Size of chunks written to the chunk store, excluding chunks that "
+    "were already present.");
+
+// Bounds on the size of chunks. Boundaries are placed where the top
+// bits of the rolling hash are zero, yielding chunks of 8 KiB on
+// average beyond the minimum size.
+constexpr std::size_t kMinChunkSize = 2 * 1024;
+constexpr std::size_t kMaxChunkSize = 64 * 1024;
+constexpr std::uint64_t kBoundaryMask = std::uint64_t(0x1fff) << 51;
+
+// Random values for the Gear rolling hash, generated using SplitMix64.
+// The seed is fixed, as changing it would move the boundaries of
+// chunks, preventing deduplication against existing ones.
+const std::array<std::uint64_t, 256> gear_table = []() {
+  std::array<std::uint64_t, 256> table;
+  std::uint64_t state = 0;
+  for (std::uint64_t& value : table) {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}();
+
+class DirDeleter {
+ public:
+  void operator()(DIR* directory) const {
+    if (directory != nullptr)
+      closedir(directory);
+  }
+};
+
+std::string ToHex(const unsigned char* data, std::size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(length * 2);
+  for (std::size_t i = 0; i < length; ++i) {
+    hex.push_back(digits[data[i] >> 4]);
+    hex.push_back(digits[data[i] & 0xf]);
+  }
+  return hex;
+}
+
+std::string ComputeChecksum(std::string_view data) {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(),
+         digest);
+  return ToHex(digest, sizeof(digest));
+}
+
+FileDescriptor OpenSubdirectory(const FileDescriptor& directory,
+                                const char* name) {
+  if (mkdirat(directory.get(), name, 0777) != 0 && errno != EEXIST)
+    throw std::system_error(errno, std::system_category(), name);
+  int fd = openat(directory.get(), name, O_DIRECTORY | O_SEARCH);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name);
+  return FileDescriptor(fd);
+}
+
+std::string ReadFile(int fd) {
+  std::string data;
+  char buffer[65536];
+  for (;;) {
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length < 0)
+      throw std::system_error(errno, std::system_category(), "read");
+    if (length == 0)
+      return data;
+    data.append(buffer, length);
+  }
+}
+
+void WriteFully(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t length = write(fd, data.data(), data.size());
+    if (length < 0)
+      throw std::system_error(errno, std::system_category(), "write");
+    data.remove_prefix(length);
+  }
+}
+
+// Writes a file through a temporary one, so that it either appears
+// completely or not at all. The contents are flushed to disk before
+// the file appears, but the directory itself is not.
+void WriteFileAtomically(int directory, const std::string& name,
+                         std::string_view data) {
+  std::string temporary_name = "." + name;
+  int fd = openat(directory, temporary_name.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC, 0444);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), temporary_name);
+  FileDescriptor file(fd);
+  WriteFully(file.get(), data);
+  if (fsync(file.get()) != 0)
+    throw std::system_error(errno, std::system_category(), temporary_name);
+  if (renameat(directory, temporary_name.c_str(), directory,
+               name.c_str()) != 0)
+    throw std::system_error(errno, std::system_category(), name);
+}
+
+// Flushes the entries of a directory to disk.
+void SyncDirectory(const FileDescriptor& directory, const char* name) {
+  int fd = openat(directory.get(), ".", O_DIRECTORY | O_RDONLY);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name);
+  if (fsync(FileDescriptor(fd).get()) != 0)
+    throw std::system_error(errno, std::system_category(), name);
+}
+
+}  // namespace
+
+ChunkStore::ChunkStore(const FileDescriptor* directory)
+    : chunks_(OpenSubdirectory(*directory, "chunks")),
+      manifests_(OpenSubdirectory(*directory, "manifests")) {
+}
+
+std::vector<std::size_t> ChunkStore::SplitIntoChunks_(std::string_view data) {
+  std::vector<std::size_t> lengths;
+  while (!data.empty()) {
+    std::size_t end = std::min(data.size(), kMaxChunkSize);
+    std::size_t length = end;
+    std::uint64_t hash = 0;
+    for (std::size_t i = kMinChunkSize; i < end; ++i) {
+      hash = (hash << 1) + gear_table[static_cast<unsigned char>(data[i])];
+      if ((hash & kBoundaryMask) == 0) {
+        length = i + 1;
+        break;
+      }
+    }
+    lengths.push_back(length);
+    data.remove_prefix(length);
+  }
+  return lengths;
+}
+
+std::uint64_t ChunkStore::Ingest(std::string_view image_name, int fd) {
+  std::string data = ReadFile(fd);
+  if (image_name.substr(0, 7) != "sha256:" ||
+      image_name.substr(7) != ComputeChecksum(data))
+    throw std::runtime_error("Checksum of " + std::string(image_name) +
+                             " does not match its contents");
+  std::ostringstream manifest;
+  std::uint64_t written = 0;
+  std::unique_lock lock(lock_);
+  std::string_view remaining = data;
+  for (std::size_t length : SplitIntoChunks_(data)) {
+    std::string_view chunk = remaining.substr(0, length);
+    remaining.remove_prefix(length);
+    std::string checksum = ComputeChecksum(chunk);
+    manifest << checksum << ' ' << length << '\n';
+
+    struct stat sb;
+    if (fstatat(chunks_.get(), checksum.c_str(), &sb, 0) != 0) {
+      WriteFileAtomically(chunks_.get(), checksum, chunk);
+      written += length;
+    }
+  }
+  // Callers may discard their copy of the image once this returns.
+  // Make sure the chunks are on disk before the manifest referencing
+  // them, and the manifest before returning.
+  if (written > 0)
+    SyncDirectory(chunks_, "chunks");
+  WriteFileAtomically(manifests_.get(), std::string(image_name),
+                      manifest.str());
+  SyncDirectory(manifests_, "manifests");
+  ingested_bytes->Increment(data.size());
+  stored_bytes->Increment(written);
+  return written;
+}
+
+std::optional<std::uint64_t> ChunkStore::GetSize(std::string_view image_name) {
+  std::unique_lock lock(lock_);
+  std::optional<std::vector<ManifestEntry>> manifest =
+      ReadManifest_(image_name);
+  if (!manifest)
+    return {};
+  std::uint64_t size = 0;
+  for (const ManifestEntry& entry : *manifest)
+    size += entry.length;
+  return size;
+}
+
+std::vector<std::string> ChunkStore::List() {
+  std::unique_lock lock(lock_);
+  std::unique_ptr<DIR, DirDeleter> directory(opendirat(manifests_.get(), "."));
+  if (!directory)
+    throw std::system_error(errno, std::system_category(), "manifests");
+  std::vector<std::string> image_names;
+  for (dirent* entry = readdir(directory.get()); entry != nullptr;
+       entry = readdir(directory.get())) {
+    // Skip temporary files.
+    if (entry->d_name[0] != '.')
+      image_names.push_back(entry->d_name);
+  }
+  return image_names;
+}
+
+void ChunkStore::Materialize(std::string_view image_name, int directory) {
+  std::unique_lock lock(lock_);
+  std::optional<std::vector<ManifestEntry>> manifest =
+      ReadManifest_(image_name);
+  if (!manifest)
+    throw std::system_error(ENOENT, std::system_category(),
+                            std::string(image_name));
+
+  // Assemble the image from its chunks, verifying its checksum. Chunks
+  // are not aligned to file system blocks, so they cannot be cloned.
+  std::string temporary_name = "." + std::string(image_name);
+  int fd = openat(directory, temporary_name.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC, 0555);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), temporary_name);
+  FileDescriptor file(fd);
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  for (const ManifestEntry& entry : *manifest) {
+    int chunk_fd = openat(chunks_.get(), entry.checksum.c_str(), O_RDONLY);
+    if (chunk_fd < 0)
+      throw std::system_error(errno, std::system_category(), entry.checksum);
+    std::string chunk = ReadFile(FileDescriptor(chunk_fd).get());
+    SHA256_Update(&context, chunk.data(), chunk.size());
+    WriteFully(file.get(), chunk);
+  }
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &context);
+  if (image_name.substr(0, 7) != "sha256:" ||
+      image_name.substr(7) != ToHex(digest, sizeof(digest))) {
+    unlinkat(directory, temporary_name.c_str(), 0);
+    throw std::runtime_error("Checksum of " + std::string(image_name) +
+                             " does not match its contents");
+  }
+  if (renameat(directory, temporary_name.c_str(), directory,
+               std::string(image_name).c_str()) != 0)
+    throw std::system_error(errno, std::system_category(),
+                            std::string(image_name));
+}
+
+void ChunkStore::Remove(std::string_view image_name) {
+  std::unique_lock lock(lock_);
+  if (unlinkat(manifests_.get(), std::string(image_name).c_str(), 0) != 0) {
+    if (errno == ENOENT)
+      return;
+    throw std::system_error(errno, std::system_category(),
+                            std::string(image_name));
+  }
+
+  // Determine which chunks are still in use by other images.
+  std::set<std::string, std::less<>> referenced;
+  {
+    std::unique_ptr<DIR, DirDeleter> directory(
+        opendirat(manifests_.get(), "."));
+    if (!directory)
+      throw std::system_error(errno, std::system_category(), "manifests");
+    for (dirent* entry = readdir(directory.get()); entry != nullptr;
+         entry = readdir(directory.get())) {
+      if (entry->d_name[0] == '.')
+        continue;
+      if (std::optional<std::vector<ManifestEntry>> manifest =
+              ReadManifest_(entry->d_name);
+          manifest)
+        for (ManifestEntry& manifest_entry : *manifest)
+          referenced.insert(std::move(manifest_entry.checksum));
+    }
+  }
+
+  std::unique_ptr<DIR, DirDeleter> directory(opendirat(chunks_.get(), "."));
+  if (!directory)
+    throw std::system_error(errno, std::system_category(), "chunks");
+  for (dirent* entry = readdir(directory.get()); entry != nullptr;
+       entry = readdir(directory.get())) {
+    if (entry->d_name[0] != '.' && referenced.count(entry->d_name) == 0)
+      unlinkat(chunks_.get(), entry->d_name, 0);
+  }
+}
+
+std::optional<std::vector<ChunkStore::ManifestEntry>>
+ChunkStore::ReadManifest_(std::string_view image_name) {
+  int fd =
+      openat(manifests_.get(), std::string(image_name).c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return {};
+    throw std::system_error(errno, std::system_category(),
+                            std::string(image_name));
+  }
+  std::istringstream input(ReadFile(FileDescriptor(fd).get()));
+  std::vector<ManifestEntry> manifest;
+  ManifestEntry entry;
+  while (input >> entry.checksum >> entry.length)
+    manifest.push_back(entry);
+  return manifest;
+}
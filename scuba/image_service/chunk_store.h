@@ -0,0 +1,72 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_IMAGE_SERVICE_CHUNK_STORE_H
+#define SCUBA_IMAGE_SERVICE_CHUNK_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arpc++/arpc++.h"
+
+namespace scuba {
+namespace image_service {
+
+// Deduplicating storage for images. Images are split into chunks at
+// boundaries determined by their contents, so that successive builds
+// of an executable that only differ slightly share most of their
+// chunks. Chunks are stored once, named by their SHA-256 checksum. Each
+// image has a manifest listing its chunks.
+//
+// The directory contains a "chunks" and a "manifests" subdirectory.
+// Functions throw std::system_error on I/O errors.
+class ChunkStore {
+ public:
+  explicit ChunkStore(const arpc::FileDescriptor* directory);
+
+  // Stores the contents of a file under the name of an image, returning
+  // the number of bytes of chunks that were not stored yet. The image
+  // is on disk once this returns. Throws std::runtime_error if the
+  // contents don't match the checksum in the image name.
+  std::uint64_t Ingest(std::string_view image_name, int fd);
+  // Returns the size of a stored image, or nothing if not stored.
+  std::optional<std::uint64_t> GetSize(std::string_view image_name);
+  // Returns the names of all stored images.
+  std::vector<std::string> List();
+  // Reassembles a stored image into a file in a directory, replacing
+  // the file atomically. Throws std::runtime_error if the result does
+  // not match the checksum in the image name.
+  void Materialize(std::string_view image_name, int directory);
+  // Removes an image, along with chunks no longer used by other images.
+  void Remove(std::string_view image_name);
+
+ private:
+  // Splits the contents of a file into chunks, returning their lengths.
+  static std::vector<std::size_t> SplitIntoChunks_(std::string_view data);
+
+  struct ManifestEntry {
+    std::string checksum;
+    std::size_t length;
+  };
+
+  std::optional<std::vector<ManifestEntry>> ReadManifest_(
+      std::string_view image_name);
+
+  std::mutex lock_;
+  const arpc::FileDescriptor chunks_;
+  const arpc::FileDescriptor manifests_;
+
+  ChunkStore(ChunkStore&) = delete;
+  void operator=(ChunkStore) = delete;
+};
+
+}  // namespace image_service
+}  // namespace scuba
+
+#endif
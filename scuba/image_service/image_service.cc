@@ -9,12 +9,27 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 
 #include "grpc++/grpc++.h"
+#include "arpc++/arpc++.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.grpc.pb.h"
+#include "scuba/image_service/chunk_store.h"
 
+using arpc::FileDescriptor;
 using grpc::ServerContext;
 using grpc::Status;
 using grpc::StatusCode;
@@ -33,6 +48,10 @@ using scuba::image_service::ImageService;
 
 namespace {
 
+// Time for which copies of images in the image directory are retained
+// after being referenced, when images are stored in a chunk store.
+constexpr std::chrono::minutes kImageRetention(10);
+
 class DirDeleter {
  public:
   void operator()(DIR* directory) const {
@@ -51,11 +70,12 @@ Status ImageService::ListImages(ServerContext* context,
   if (!directory)
     return {StatusCode::INTERNAL, std::strerror(errno)};
 
+  std::set<std::string, std::less<>> listed;
   for (dirent* entry = readdir(directory.get()); entry != nullptr;
        entry = readdir(directory.get())) {
     // TODO(ed): Respect filter.
     if (IsLocalImageName_(entry->d_name)) {
-      stat sb;
+      struct stat sb;
       if (fstatat(image_directory_->get(), entry->d_name, &sb,
                   AT_SYMLINK_NOFOLLOW) == 0 &&
           S_ISREG(sb.st_mode)) {
@@ -63,6 +83,7 @@ Status ImageService::ListImages(ServerContext* context,
         image->set_id(entry->d_name);
         // TODO(ed): Set repo_tags.
         image->set_size(sb.st_size);
+        listed.insert(entry->d_name);
       }
     } else {
       // Filename doesn't match a supported image name pattern. It
@@ -71,6 +92,26 @@ Status ImageService::ListImages(ServerContext* context,
       // TODO(ed): Implement.
     }
   }
+
+  // Images that are only present in the chunk store.
+  if (chunk_store_ != nullptr) {
+    StoreImages_(listed);
+    try {
+      for (const std::string& image_name : chunk_store_->List()) {
+        if (listed.count(image_name) > 0)
+          continue;
+        if (std::optional<std::uint64_t> size =
+                chunk_store_->GetSize(image_name);
+            size) {
+          Image* image = response->add_images();
+          image->set_id(image_name);
+          image->set_size(*size);
+        }
+      }
+    } catch (const std::exception& e) {
+      return {StatusCode::INTERNAL, e.what()};
+    }
+  }
   return Status::OK;
 }
 
@@ -83,7 +124,24 @@ Status ImageService::ImageStatus(ServerContext* context,
     return {StatusCode::UNIMPLEMENTED, "ImageStatus by URL not implemented"};
   }
 
-  stat sb;
+  struct stat sb;
+  if (chunk_store_ != nullptr) {
+    {
+      std::unique_lock lock(last_referenced_lock_);
+      last_referenced_[image_name] = std::chrono::steady_clock::now();
+    }
+
+    // Reassemble the image if it is only present in the chunk store.
+    try {
+      if (fstatat(image_directory_->get(), image_name.c_str(), &sb,
+                  AT_SYMLINK_NOFOLLOW) != 0 &&
+          errno == ENOENT && chunk_store_->GetSize(image_name))
+        chunk_store_->Materialize(image_name, image_directory_->get());
+    } catch (const std::exception& e) {
+      return {StatusCode::INTERNAL, e.what()};
+    }
+  }
+
   if (fstatat(image_directory_->get(), image_name.c_str(), &sb,
               AT_SYMLINK_NOFOLLOW) == 0 &&
       S_ISREG(sb.st_mode)) {
@@ -91,6 +149,11 @@ Status ImageService::ImageStatus(ServerContext* context,
     image->set_id(image_name);
     // TODO(ed): Set repo_tags.
     image->set_size(sb.st_size);
+
+    // The kubelet requests the status of an image before creating a
+    // container from it, making this a good moment to prefetch it.
+    if (image_warmer_ != nullptr)
+      image_warmer_->Prewarm(image_name);
   }
   return Status::OK;
 }
@@ -116,9 +179,18 @@ Status ImageService::RemoveImage(ServerContext* context,
     return {StatusCode::UNIMPLEMENTED, "RemoveImage by URL not implemented"};
   }
 
+  if (image_warmer_ != nullptr)
+    image_warmer_->Forget(image_name);
   if (unlinkat(image_directory_->get(), image_name.c_str(), 0) != 0 &&
       errno != ENOENT)
     return {StatusCode::INTERNAL, std::strerror(errno)};
+  if (chunk_store_ != nullptr) {
+    try {
+      chunk_store_->Remove(image_name);
+    } catch (const std::exception& e) {
+      return {StatusCode::INTERNAL, e.what()};
+    }
+  }
   return Status::OK;
 }
 
@@ -134,3 +206,68 @@ bool ImageService::IsLocalImageName_(std::string_view image_name) {
            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
          });
 }
+
+void ImageService::StoreImages_(
+    std::set<std::string, std::less<>> image_names) {
+  std::unique_lock lock(pending_images_lock_);
+  pending_images_.merge(image_names);
+  if (storing_images_ || pending_images_.empty())
+    return;
+  storing_images_ = true;
+  std::thread([this]() {
+    std::unique_lock lock(pending_images_lock_);
+    while (!pending_images_.empty()) {
+      std::string image_name =
+          std::move(pending_images_.extract(pending_images_.begin()).value());
+      lock.unlock();
+      StoreImage_(image_name);
+      lock.lock();
+    }
+    storing_images_ = false;
+  })
+      .detach();
+}
+
+void ImageService::StoreImage_(std::string_view image_name) {
+  // Critical images are kept resident, which requires them to remain
+  // present in the image directory.
+  if (image_warmer_ != nullptr && image_warmer_->IsPinned(image_name))
+    return;
+
+  auto recently_referenced = [this, image_name]() {
+    auto last_referenced = last_referenced_.find(image_name);
+    if (last_referenced == last_referenced_.end())
+      return false;
+    if (std::chrono::steady_clock::now() - last_referenced->second <
+        kImageRetention)
+      return true;
+    last_referenced_.erase(last_referenced);
+    return false;
+  };
+  {
+    std::unique_lock lock(last_referenced_lock_);
+    if (recently_referenced())
+      return;
+  }
+
+  std::string path(image_name);
+  try {
+    if (!chunk_store_->GetSize(image_name)) {
+      int fd = openat(image_directory_->get(), path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      chunk_store_->Ingest(image_name, FileDescriptor(fd).get());
+    }
+  } catch (const std::exception& e) {
+    // Leave images that cannot be stored in place.
+    return;
+  }
+
+  // Only remove the copy if it didn't get referenced in the meantime.
+  std::unique_lock lock(last_referenced_lock_);
+  if (!recently_referenced()) {
+    if (image_warmer_ != nullptr)
+      image_warmer_->Forget(image_name);
+    unlinkat(image_directory_->get(), path.c_str(), 0);
+  }
+}
@@ -5,19 +5,32 @@
 #ifndef SCUBA_IMAGE_SERVICE_IMAGE_SERVICE_H
 #define SCUBA_IMAGE_SERVICE_IMAGE_SERVICE_H
 
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
 #include <string_view>
 
 #include "arpc++/arpc++.h"
 #include "grpc++/grpc++.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.grpc.pb.h"
+#include "scuba/image_service/chunk_store.h"
+#include "scuba/image_service/image_warmer.h"
 
 namespace scuba {
 namespace image_service {
 
 class ImageService final : public runtime::ImageService::Service {
  public:
-  ImageService(const arpc::FileDescriptor* image_directory)
-      : image_directory_(image_directory) {
+  // Images are optionally kept in the page cache by an image warmer.
+  // If a chunk store is provided, images are stored in it and only
+  // placed in the image directory while they are being used.
+  ImageService(const arpc::FileDescriptor* image_directory,
+               ImageWarmer* image_warmer, ChunkStore* chunk_store)
+      : image_directory_(image_directory),
+        image_warmer_(image_warmer),
+        chunk_store_(chunk_store) {
   }
 
   grpc::Status ListImages(grpc::ServerContext* context,
@@ -38,10 +51,32 @@ class ImageService final : public runtime::ImageService::Service {
 
  private:
   const arpc::FileDescriptor* const image_directory_;
+  ImageWarmer* const image_warmer_;
+  ChunkStore* const chunk_store_;
+
+  // Times at which images in the chunk store were last referenced.
+  // Copies in the image directory that have not been referenced
+  // recently are removed.
+  std::mutex last_referenced_lock_;
+  std::map<std::string, std::chrono::steady_clock::time_point, std::less<>>
+      last_referenced_;
+
+  // Images in the image directory that still need to be moved into the
+  // chunk store. This is done by a background thread, as ingesting
+  // large images would otherwise delay listing them.
+  std::mutex pending_images_lock_;
+  std::set<std::string, std::less<>> pending_images_;
+  bool storing_images_ = false;
 
   // Returns whether the name of an image corresponds with a locally
   // stored image, i.e., it is named "sha256:....".
   static bool IsLocalImageName_(std::string_view image_name);
+  // Moves images in the image directory into the chunk store in the
+  // background, starting a thread if none is running.
+  void StoreImages_(std::set<std::string, std::less<>> image_names);
+  // Moves an image in the image directory into the chunk store, if not
+  // stored already. The copy is removed if it is not in use.
+  void StoreImage_(std::string_view image_name);
 
   ImageService(ImageService&) = delete;
   void operator=(ImageService) = delete;
@@ -0,0 +1,80 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/image_service/image_warmer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "arpc++/arpc++.h"
+#include "scuba/util/metrics.h"
+#include "scuba/util/page_cache.h"
+
+using arpc::FileDescriptor;
+using scuba::image_service::ImageWarmer;
+using scuba::util::Counter;
+using scuba::util::Gauge;
+using scuba::util::MetricsRegistry;
+using scuba::util::PinnedFile;
+using scuba::util::PrefetchFile;
+
+namespace {
+
+Counter* const prewarms = MetricsRegistry::Default()->GetCounter(
+    "scuba_image_prewarms_total",
+    "Number of times images were prefetched into the page cache.");
+Gauge* const pinned_bytes = MetricsRegistry::Default()->GetGauge(
+    "scuba_image_pinned_bytes",
+    "Size of critical images kept resident in memory.");
+
+}  // namespace
+
+ImageWarmer::ImageWarmer(const FileDescriptor* image_directory,
+                         std::set<std::string, std::less<>> pinned_images)
+    : image_directory_(image_directory),
+      pinned_images_(std::move(pinned_images)) {
+  // Pin critical images that are already present.
+  for (const std::string& image_name : pinned_images_)
+    Prewarm(image_name);
+}
+
+void ImageWarmer::Prewarm(std::string_view image_name) {
+  int fd = openat(image_directory_->get(), std::string(image_name).c_str(),
+                  O_RDONLY);
+  if (fd < 0)
+    return;
+  FileDescriptor image(fd);
+  PrefetchFile(image.get());
+  prewarms->Increment();
+
+  if (pinned_images_.count(image_name) == 0)
+    return;
+  std::unique_lock lock(lock_);
+  if (pinned_files_.count(image_name) > 0)
+    return;
+  try {
+    auto pinned_file = std::make_unique<PinnedFile>(image.get());
+    pinned_bytes->Add(pinned_file->GetSize());
+    pinned_files_.emplace(image_name, std::move(pinned_file));
+  } catch (const std::system_error& e) {
+    // Retry when the image is referenced again.
+  }
+}
+
+void ImageWarmer::Forget(std::string_view image_name) {
+  std::unique_lock lock(lock_);
+  auto pinned_file = pinned_files_.find(image_name);
+  if (pinned_file != pinned_files_.end()) {
+    pinned_bytes->Add(-std::int64_t(pinned_file->second->GetSize()));
+    pinned_files_.erase(pinned_file);
+  }
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_IMAGE_SERVICE_IMAGE_WARMER_H
+#define SCUBA_IMAGE_SERVICE_IMAGE_WARMER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "arpc++/arpc++.h"
+#include "scuba/util/page_cache.h"
+
+namespace scuba {
+namespace image_service {
+
+// Keeps images in the page cache, so that containers don't need to
+// read their executables from disk while starting. Images are
+// prefetched when referenced, while critical images are kept resident
+// for as long as they are present.
+class ImageWarmer {
+ public:
+  ImageWarmer(const arpc::FileDescriptor* image_directory,
+              std::set<std::string, std::less<>> pinned_images);
+
+  // Prefetches a locally stored image, pinning it if it is critical.
+  void Prewarm(std::string_view image_name);
+  // Releases an image that is about to be removed.
+  void Forget(std::string_view image_name);
+  // Returns whether an image is critical, meaning it is kept resident.
+  bool IsPinned(std::string_view image_name) const {
+    return pinned_images_.count(image_name) > 0;
+  }
+
+ private:
+  const arpc::FileDescriptor* const image_directory_;
+  const std::set<std::string, std::less<>> pinned_images_;
+
+  std::mutex lock_;
+  std::map<std::string, std::unique_ptr<util::PinnedFile>, std::less<>>
+      pinned_files_;
+
+  ImageWarmer(ImageWarmer&) = delete;
+  void operator=(ImageWarmer) = delete;
+};
+
+}  // namespace image_service
+}  // namespace scuba
+
+#endif
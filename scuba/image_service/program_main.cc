@@ -4,15 +4,28 @@
 
 #include <program.h>
 #include <stdio.h>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "arpc++/arpc++.h"
 #include "flower/protocol/switchboard.ad.h"
 #include "grpc++/grpc++.h"
+#include "scuba/image_service/chunk_store.h"
 #include "scuba/image_service/configuration.ad.h"
 #include "scuba/image_service/image_service.h"
+#include "scuba/image_service/image_warmer.h"
 #include "scuba/util/grpc_connection_injector.h"
+#include "scuba/util/grpc_metrics_interceptor.h"
+#include "scuba/util/grpc_request_recorder.h"
+#include "scuba/util/metrics.h"
 
 using arpc::ArgdataParser;
 using arpc::ClientContext;
@@ -21,9 +34,14 @@ using arpc::Status;
 using flower::protocol::switchboard::ServerStartRequest;
 using flower::protocol::switchboard::ServerStartResponse;
 using flower::protocol::switchboard::Switchboard;
+using scuba::image_service::ChunkStore;
 using scuba::image_service::Configuration;
 using scuba::image_service::ImageService;
+using scuba::image_service::ImageWarmer;
 using scuba::util::GrpcConnectionInjector;
+using scuba::util::GrpcMetricsInterceptorFactory;
+using scuba::util::GrpcRequestRecorderFactory;
+using scuba::util::MetricsRegistry;
 
 void program_main(const argdata_t* ad) {
   Configuration configuration;
@@ -54,10 +72,62 @@ void program_main(const argdata_t* ad) {
   if (!image_directory)
     std::exit(1);
 
+  // Periodically export metrics for Prometheus' textfile collector.
+  if (std::shared_ptr<FileDescriptor> metrics_directory =
+          configuration.metrics_directory();
+      metrics_directory) {
+    std::thread([metrics_directory]() {
+      for (;;) {
+        try {
+          MetricsRegistry::Default()->WriteTextFile(*metrics_directory,
+                                                    "scuba_image_service.prom");
+        } catch (const std::exception& e) {
+          std::cerr << "Failed to export metrics: " << e.what() << std::endl;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(15));
+      }
+    }).detach();
+  }
+
+  // Keep images in the page cache if requested.
+  std::unique_ptr<ImageWarmer> image_warmer;
+  if (configuration.prewarm_images() ||
+      !configuration.pinned_images().empty())
+    image_warmer = std::make_unique<ImageWarmer>(
+        image_directory.get(),
+        std::set<std::string, std::less<>>(
+            configuration.pinned_images().begin(),
+            configuration.pinned_images().end()));
+
+  // Store images deduplicated if requested.
+  std::unique_ptr<ChunkStore> chunk_store;
+  if (const std::shared_ptr<FileDescriptor>& chunk_directory =
+          configuration.chunk_directory();
+      chunk_directory) {
+    try {
+      chunk_store = std::make_unique<ChunkStore>(chunk_directory.get());
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to open chunk store: " << e.what() << std::endl;
+      std::exit(1);
+    }
+  }
+
   // Start the CRI service using GRPC.
-  ImageService image_service(image_directory.get());
+  ImageService image_service(image_directory.get(), image_warmer.get(),
+                             chunk_store.get());
   grpc::ServerBuilder cri_builder;
   cri_builder.RegisterService(&image_service);
+  std::vector<
+      std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>>
+      interceptors;
+  interceptors.push_back(std::make_unique<GrpcMetricsInterceptorFactory>(
+      MetricsRegistry::Default()));
+  if (const std::shared_ptr<FileDescriptor>& request_log =
+          configuration.request_log();
+      request_log)
+    interceptors.push_back(
+        std::make_unique<GrpcRequestRecorderFactory>(request_log));
+  cri_builder.experimental().SetInterceptorCreators(std::move(interceptors));
   std::unique_ptr<grpc::Server> cri_server(cri_builder.BuildAndStart());
   if (!cri_server)
     std::exit(1);
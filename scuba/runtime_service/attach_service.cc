@@ -0,0 +1,51 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/attach_service.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/attach.grpc.pb.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/runtime_service.h"
+
+using grpc::ServerContext;
+using grpc::ServerWriter;
+using grpc::Status;
+using grpc::StatusCode;
+using scuba::attach::AttachRequest;
+using scuba::attach::OutputChunk;
+using scuba::runtime_service::AttachService;
+using scuba::runtime_service::LogRing;
+
+Status AttachService::Attach(ServerContext* context,
+                             const AttachRequest* request,
+                             ServerWriter<OutputChunk>* writer) {
+  std::shared_ptr<LogRing> output =
+      runtime_service_->GetContainerOutput(request->container_id());
+  if (!output)
+    return {StatusCode::NOT_FOUND, "Container does not exist"};
+
+  std::uint64_t offset = request->from_start() ? 0 : output->GetEnd();
+  while (!context->IsCancelled()) {
+    if (output->IsFinished(offset))
+      return Status::OK;
+    // Wait for new output in bounded intervals, so that cancellation of
+    // the call is noticed even if the container remains silent.
+    OutputChunk chunk;
+    std::uint64_t start =
+        output->Read(offset, std::chrono::seconds(1), chunk.mutable_data());
+    if (chunk.data().empty())
+      continue;
+    chunk.set_offset(start);
+    chunk.set_dropped_bytes(start - offset);
+    if (!writer->Write(chunk))
+      return Status::OK;
+    offset = start + chunk.data().size();
+  }
+  return {StatusCode::CANCELLED, "Call cancelled by client"};
+}
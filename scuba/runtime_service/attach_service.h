@@ -0,0 +1,36 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_ATTACH_SERVICE_H
+#define SCUBA_RUNTIME_SERVICE_ATTACH_SERVICE_H
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/attach.grpc.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+class RuntimeService;
+
+class AttachService final : public attach::AttachService::Service {
+ public:
+  explicit AttachService(RuntimeService* runtime_service)
+      : runtime_service_(runtime_service) {
+  }
+
+  grpc::Status Attach(grpc::ServerContext* context,
+                      const attach::AttachRequest* request,
+                      grpc::ServerWriter<attach::OutputChunk>* writer) override;
+
+ private:
+  RuntimeService* const runtime_service_;
+
+  AttachService(AttachService&) = delete;
+  void operator=(AttachService) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,137 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/binary_argdata.h"
+
+#include <argdata.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/repeated_field.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/interned_config.h"
+
+using google::protobuf::RepeatedPtrField;
+using runtime::ArgdataDescriptor;
+using scuba::runtime_service::BinaryArgdata;
+using scuba::runtime_service::InternedMounts;
+
+namespace {
+
+// State for checking placeholders while traversing the data.
+struct Placeholders {
+  std::size_t count;
+  bool out_of_range;
+};
+
+int CheckPlaceholder(void* arg, std::size_t fd) {
+  Placeholders* placeholders = static_cast<Placeholders*>(arg);
+  if (fd >= placeholders->count) {
+    placeholders->out_of_range = true;
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+void BinaryArgdata::Validate(
+    std::string_view data,
+    const RepeatedPtrField<ArgdataDescriptor>& descriptors,
+    const InternedMounts& mounts) {
+  if (data.empty()) {
+    if (!descriptors.empty())
+      throw std::invalid_argument(
+          "Argdata descriptors can only be used with binary argdata");
+    return;
+  }
+
+  for (const ArgdataDescriptor& descriptor : descriptors) {
+    switch (descriptor.descriptor_case()) {
+      case ArgdataDescriptor::kContainerLog:
+        break;
+      case ArgdataDescriptor::kMount: {
+        bool found = false;
+        for (const auto& mount : mounts)
+          found = found || *mount.container_path == descriptor.mount();
+        if (!found)
+          throw std::invalid_argument("Unknown volume mount: " +
+                                      descriptor.mount());
+        break;
+      }
+      case ArgdataDescriptor::kServer:
+        // Labels with this prefix identify the container.
+        for (const auto& label : descriptor.server().labels())
+          if (label.first.compare(0, 18, "server_kubernetes_") == 0)
+            throw std::invalid_argument(
+                "Attempted to override predefined label \"" + label.first +
+                '"');
+        break;
+      default:
+        throw std::invalid_argument("Argdata descriptor has no type");
+    }
+  }
+
+  // Traverse the data, so that all placeholders are converted.
+  Placeholders placeholders = {std::size_t(descriptors.size()), false};
+  argdata_t* argdata = argdata_from_buffer(data.data(), data.size(),
+                                           CheckPlaceholder, &placeholders);
+  if (argdata == nullptr)
+    throw std::bad_alloc();
+  std::vector<const argdata_t*> pending = {argdata};
+  while (!pending.empty()) {
+    const argdata_t* ad = pending.back();
+    pending.pop_back();
+    int fd;
+    if (argdata_get_fd(ad, &fd) == 0)
+      continue;
+
+    argdata_map_iterator_t map;
+    argdata_map_iterate(ad, &map);
+    const argdata_t *key, *value;
+    while (argdata_map_get(&map, &key, &value)) {
+      pending.push_back(key);
+      pending.push_back(value);
+      argdata_map_next(&map);
+    }
+    if (map.index != ARGDATA_ITERATOR_INVALID)
+      continue;
+
+    argdata_seq_iterator_t seq;
+    argdata_seq_iterate(ad, &seq);
+    const argdata_t* element;
+    while (argdata_seq_get(&seq, &element)) {
+      pending.push_back(element);
+      argdata_seq_next(&seq);
+    }
+  }
+  argdata_free(argdata);
+  if (placeholders.out_of_range)
+    throw std::invalid_argument(
+        "Binary argdata references a nonexistent argdata descriptor");
+}
+
+BinaryArgdata::BinaryArgdata(std::string_view data, std::vector<int> fds)
+    : fds_(std::move(fds)),
+      argdata_(argdata_from_buffer(data.data(), data.size(), ConvertFd_,
+                                   const_cast<std::vector<int>*>(&fds_))) {
+  if (argdata_ == nullptr)
+    throw std::bad_alloc();
+}
+
+BinaryArgdata::~BinaryArgdata() {
+  argdata_free(argdata_);
+}
+
+int BinaryArgdata::ConvertFd_(void* arg, std::size_t fd) {
+  const std::vector<int>* fds = static_cast<const std::vector<int>*>(arg);
+  return fd < fds->size() ? (*fds)[fd] : -1;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_BINARY_ARGDATA_H
+#define SCUBA_RUNTIME_SERVICE_BINARY_ARGDATA_H
+
+#include <argdata.h>
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "google/protobuf/repeated_field.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/interned_config.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Argument data in its binary encoding, as provided through
+// ContainerConfig.argdata_binary. File descriptor numbers in the data
+// are placeholders: indices into ContainerConfig.argdata_descriptors.
+// This allows a container to be started without converting its
+// argument data from YAML.
+class BinaryArgdata {
+ public:
+  // Throws std::invalid_argument if the data cannot be decoded, or if
+  // it references descriptors that don't exist or cannot be provided.
+  static void Validate(
+      std::string_view data,
+      const google::protobuf::RepeatedPtrField<runtime::ArgdataDescriptor>&
+          descriptors,
+      const InternedMounts& mounts);
+
+  // Decodes the data, replacing placeholders by the file descriptors
+  // with the same indices. The data is not copied, meaning that it and
+  // the file descriptors must outlive the decoded argument data.
+  BinaryArgdata(std::string_view data, std::vector<int> fds);
+  ~BinaryArgdata();
+
+  const argdata_t* Get() const {
+    return argdata_;
+  }
+
+ private:
+  static int ConvertFd_(void* arg, std::size_t fd);
+
+  const std::vector<int> fds_;
+  argdata_t* const argdata_;
+
+  BinaryArgdata(BinaryArgdata&) = delete;
+  void operator=(BinaryArgdata) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
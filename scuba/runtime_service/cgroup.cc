@@ -0,0 +1,152 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/cgroup.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "arpc++/arpc++.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+
+using arpc::FileDescriptor;
+using runtime::LinuxContainerResources;
+using scuba::runtime_service::Cgroup;
+
+namespace {
+
+// Default period of the CFS bandwidth controller, in microseconds.
+constexpr std::int64_t kDefaultCpuPeriod = 100000;
+
+}  // namespace
+
+Cgroup::Cgroup(const Cgroup* parent, std::string_view name)
+    : parent_(parent), name_(name) {
+  if (mkdirat(parent_->directory_->get(), name_.c_str(), 0755) != 0 &&
+      errno != EEXIST)
+    throw std::system_error(errno, std::system_category(), name_);
+  int fd = openat(parent_->directory_->get(), name_.c_str(),
+                  O_DIRECTORY | O_SEARCH);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name_);
+  directory_ = std::make_shared<FileDescriptor>(fd);
+}
+
+Cgroup::~Cgroup() {
+  // Removal fails if processes are still part of the control group.
+  // Leave it in place in that case, as it is reused when recreated.
+  if (parent_ != nullptr)
+    unlinkat(parent_->directory_->get(), name_.c_str(), AT_REMOVEDIR);
+}
+
+void Cgroup::EnableControllers(bool cpuset) {
+  WriteFile_("cgroup.subtree_control",
+             cpuset ? "+cpu +cpuset +memory" : "+cpu +memory");
+}
+
+void Cgroup::SetResources(const LinuxContainerResources& resources) {
+  // Kubernetes expresses CPU weights as cgroup v1 shares, ranging from
+  // 2 to 262144. Map them linearly onto v2 weights, ranging from 1 to
+  // 10000, so that the default of 1024 shares becomes a weight of 39.
+  if (resources.cpu_shares() > 0) {
+    std::int64_t shares = std::clamp(resources.cpu_shares(), std::int64_t(2),
+                                     std::int64_t(262144));
+    WriteFile_("cpu.weight", std::to_string(1 + (shares - 2) * 9999 / 262142));
+  }
+
+  std::int64_t period = resources.cpu_period() > 0 ? resources.cpu_period()
+                                                   : kDefaultCpuPeriod;
+  WriteFile_("cpu.max", (resources.cpu_quota() > 0
+                             ? std::to_string(resources.cpu_quota())
+                             : std::string("max")) +
+                            " " + std::to_string(period));
+  WriteFile_("memory.max",
+             resources.memory_limit_in_bytes() > 0
+                 ? std::to_string(resources.memory_limit_in_bytes())
+                 : std::string("max"));
+}
+
+void Cgroup::SetCpuSet(std::string_view cpus, std::string_view mems) {
+  // Set the nodes first, so that memory is never bound to nodes on
+  // which none of the CPUs reside.
+  if (!mems.empty())
+    WriteFile_("cpuset.mems", mems);
+  WriteFile_("cpuset.cpus", cpus);
+}
+
+void Cgroup::AddProcess(pid_t pid) {
+  WriteFile_("cgroup.procs", std::to_string(pid));
+}
+
+std::uint64_t Cgroup::GetCpuUsage() {
+  return ReadStat_("cpu.stat", "usage_usec") * 1000;
+}
+
+std::uint64_t Cgroup::GetMemoryWorkingSet() {
+  // Computed the same way as cAdvisor does, so that the numbers match
+  // those reported by other container runtimes.
+  std::uint64_t current = std::strtoull(ReadFile_("memory.current").c_str(),
+                                        nullptr, 10);
+  std::uint64_t inactive_file = ReadStat_("memory.stat", "inactive_file");
+  return current > inactive_file ? current - inactive_file : 0;
+}
+
+std::string Cgroup::GetEffectiveCpus() {
+  std::string cpus = ReadFile_("cpuset.cpus.effective");
+  while (!cpus.empty() && cpus.back() == '\n')
+    cpus.pop_back();
+  return cpus;
+}
+
+void Cgroup::WriteFile_(const char* name, std::string_view value) {
+  int fd = openat(directory_->get(), name, O_WRONLY);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name);
+  FileDescriptor file(fd);
+  if (write(file.get(), value.data(), value.size()) != ssize_t(value.size()))
+    throw std::system_error(errno, std::system_category(), name);
+}
+
+std::uint64_t Cgroup::ReadStat_(const char* name, std::string_view key) {
+  // Statistics are stored as lines of space separated keys and values.
+  std::string contents = ReadFile_(name);
+  std::string_view remaining = contents;
+  while (!remaining.empty()) {
+    std::string_view line = remaining.substr(0, remaining.find('\n'));
+    remaining.remove_prefix(std::min(line.size() + 1, remaining.size()));
+    if (line.size() > key.size() && line.substr(0, key.size()) == key &&
+        line[key.size()] == ' ')
+      return std::strtoull(std::string(line.substr(key.size() + 1)).c_str(),
+                           nullptr, 10);
+  }
+  return 0;
+}
+
+std::string Cgroup::ReadFile_(const char* name) {
+  int fd = openat(directory_->get(), name, O_RDONLY);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name);
+  FileDescriptor file(fd);
+  std::string contents;
+  for (;;) {
+    char buffer[4096];
+    ssize_t length = read(file.get(), buffer, sizeof(buffer));
+    if (length < 0)
+      throw std::system_error(errno, std::system_category(), name);
+    if (length == 0)
+      return contents;
+    contents.append(buffer, length);
+  }
+}
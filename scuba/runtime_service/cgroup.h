@@ -0,0 +1,67 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_CGROUP_H
+#define SCUBA_RUNTIME_SERVICE_CGROUP_H
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "arpc++/arpc++.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Control group in a cgroup v2 hierarchy, through which resource limits
+// are applied to processes and their usage is accounted.
+class Cgroup {
+ public:
+  // Wraps an existing control group, such as the root of a hierarchy
+  // that has been delegated to the runtime service.
+  explicit Cgroup(std::shared_ptr<arpc::FileDescriptor> directory)
+      : parent_(nullptr), directory_(std::move(directory)) {
+  }
+  // Creates a control group nested in another one, or reuses it if it
+  // already exists. It is removed when destroyed.
+  Cgroup(const Cgroup* parent, std::string_view name);
+  ~Cgroup();
+
+  // Allows limits on CPU and memory usage to be applied to nested
+  // control groups, optionally including CPU and NUMA node placement.
+  void EnableControllers(bool cpuset);
+  void SetResources(const runtime::LinuxContainerResources& resources);
+  // Restricts processes to a set of CPUs and, if not empty, the memory
+  // of a set of NUMA nodes.
+  void SetCpuSet(std::string_view cpus, std::string_view mems);
+  void AddProcess(pid_t pid);
+
+  // Cumulative CPU time consumed by all processes, in nanoseconds.
+  std::uint64_t GetCpuUsage();
+  // Memory in use, excluding page cache that can be reclaimed.
+  std::uint64_t GetMemoryWorkingSet();
+  // CPUs on which processes may run, using the syntax of cpuset.cpus.
+  std::string GetEffectiveCpus();
+
+  Cgroup(Cgroup&) = delete;
+  void operator=(Cgroup) = delete;
+
+ private:
+  void WriteFile_(const char* name, std::string_view value);
+  std::uint64_t ReadStat_(const char* name, std::string_view key);
+  std::string ReadFile_(const char* name);
+
+  const Cgroup* const parent_;
+  const std::string name_;
+  std::shared_ptr<arpc::FileDescriptor> directory_;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
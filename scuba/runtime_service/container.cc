@@ -13,25 +13,52 @@
 #include <cassert>
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <ctime>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <system_error>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "argdata.hpp"
 #include "google/protobuf/map.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/binary_argdata.h"
+#include "scuba/runtime_service/cgroup.h"
+#include "scuba/runtime_service/cpu_set_allocator.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/events.pb.h"
 #include "scuba/runtime_service/iso8601_timestamp.h"
+#include "scuba/runtime_service/log_buffer.h"
+#include "scuba/runtime_service/log_framer.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/journal.pb.h"
+#include "scuba/runtime_service/naming_scheme.h"
 #include "scuba/runtime_service/pod_sandbox.h"
+#include "scuba/runtime_service/server_switchboard.h"
+#include "scuba/runtime_service/start_scheduler.h"
+#include "scuba/runtime_service/state_journal.h"
 #include "scuba/runtime_service/yaml_file_descriptor_factory.h"
 #include "scuba/util/fd_streambuf.h"
+#include "scuba/util/metrics.h"
+#include "scuba/util/page_cache.h"
+#include "scuba/util/trace.h"
 #include "yaml2argdata/yaml_argdata_factory.h"
 #include "yaml2argdata/yaml_builder.h"
 #include "yaml2argdata/yaml_canonicalizing_factory.h"
@@ -40,41 +67,239 @@
 using arpc::FileDescriptor;
 using flower::protocol::switchboard::Switchboard;
 using google::protobuf::Map;
+using runtime::ArgdataDescriptor;
 using runtime::ContainerConfig;
+using runtime::ContainerMetadata;
 using runtime::ContainerState;
 using runtime::ContainerStatus;
+using runtime::LinuxContainerResources;
 using runtime::PodSandboxMetadata;
+using scuba::events::EventType;
+using scuba::journal::Record;
+using scuba::runtime_service::BinaryArgdata;
+using scuba::runtime_service::Cgroup;
 using scuba::runtime_service::Container;
+using scuba::runtime_service::ConstrainServerSwitchboard;
+using scuba::runtime_service::CpuSetAllocator;
+using scuba::runtime_service::CpuSetLease;
+using scuba::runtime_service::InternedMap;
+using scuba::runtime_service::LogBuffer;
+using scuba::runtime_service::LogFramer;
+using scuba::runtime_service::LogRing;
+using scuba::runtime_service::NamingScheme;
+using scuba::runtime_service::StartAdmission;
+using scuba::runtime_service::StartScheduler;
+using scuba::runtime_service::StringInterner;
+using scuba::runtime_service::ToJournalTime;
+using scuba::runtime_service::YAMLFileDescriptorFactory;
+using scuba::util::Counter;
 using scuba::util::fd_streambuf;
+using scuba::util::Histogram;
+using scuba::util::IsFileCached;
+using scuba::util::LockProfiler;
+using scuba::util::MetricsRegistry;
+using scuba::util::PrefetchFile;
+using scuba::util::ProfiledMutex;
+using scuba::util::TraceSpan;
 using yaml2argdata::YAMLArgdataFactory;
 using yaml2argdata::YAMLBuilder;
 using yaml2argdata::YAMLCanonicalizingFactory;
 using yaml2argdata::YAMLErrorFactory;
 
-std::mutex Container::child_loop_lock_;
+namespace {
+
+Histogram* const spawn_duration = MetricsRegistry::Default()->GetHistogram(
+    "scuba_container_spawn_seconds",
+    "Time spent spawning the processes of containers.", 1e-6);
+Counter* const spawn_failures = MetricsRegistry::Default()->GetCounter(
+    "scuba_container_spawn_failures_total",
+    "Number of containers whose process could not be spawned.");
+Histogram* const cold_start_duration =
+    MetricsRegistry::Default()->GetHistogram(
+        "scuba_container_start_seconds",
+        "Time spent starting containers, by whether their image was "
+        "in the page cache upon creation.",
+        1e-6, "image_cache=\"cold\"");
+Histogram* const warm_start_duration =
+    MetricsRegistry::Default()->GetHistogram(
+        "scuba_container_start_seconds",
+        "Time spent starting containers, by whether their image was "
+        "in the page cache upon creation.",
+        1e-6, "image_cache=\"warm\"");
+Counter* const log_bytes = MetricsRegistry::Default()->GetCounter(
+    "scuba_container_log_bytes_total",
+    "Number of bytes written to their logs by containers.");
+
+// Amount of recent output retained in memory for attached clients.
+constexpr std::size_t kOutputCapacity = 64 * 1024;
+
+// Returns the value of an annotation containing a non-negative
+// integer, or nothing if the annotation is not set.
+std::optional<std::uint64_t> GetIntegerAnnotation(
+    const InternedMap& annotations, const char* name) {
+  const std::string* annotation = annotations.Find(name);
+  if (annotation == nullptr)
+    return {};
+  char* end;
+  errno = 0;
+  unsigned long long value = std::strtoull(annotation->c_str(), &end, 10);
+  if (annotation->empty() || (*annotation)[0] < '0' ||
+      (*annotation)[0] > '9' || *end != '\0' || errno == ERANGE)
+    throw std::invalid_argument(std::string("Invalid value for annotation ") +
+                                name + ": " + *annotation);
+  return value;
+}
+
+// Returns the number of CPUs that a container wants to have assigned
+// exclusively, either requested explicitly through an annotation or
+// implied by a CPU limit that is a whole number of CPUs.
+std::size_t GetExclusiveCpuRequest(
+    const LinuxContainerResources& resources, const InternedMap& annotations) {
+  if (std::optional<std::uint64_t> count =
+          GetIntegerAnnotation(annotations, "scuba.nuxi.nl/exclusive-cpus"))
+    return *count;
+  if (resources.cpu_quota() > 0 && resources.cpu_period() > 0 &&
+      resources.cpu_quota() % resources.cpu_period() == 0)
+    return resources.cpu_quota() / resources.cpu_period();
+  return 0;
+}
+
+// Returns the length at which lines of output are split, which may be
+// chosen per container within bounds, as the runtime service needs to
+// buffer lines up to this length.
+std::size_t GetMaxLogLineLength(const InternedMap& annotations) {
+  if (std::optional<std::uint64_t> length = GetIntegerAnnotation(
+          annotations, "scuba.nuxi.nl/max-log-line-length"))
+    return std::clamp<std::uint64_t>(*length, 256, 1024 * 1024);
+  return LogFramer::kDefaultMaxLineLength;
+}
+
+// Returns what to do with output of the container that does not fit in
+// its log buffer.
+LogBuffer::OverflowPolicy GetLogOverflowPolicy(
+    const InternedMap& annotations) {
+  const std::string* overflow = annotations.Find("scuba.nuxi.nl/log-overflow");
+  if (overflow == nullptr || *overflow == "drop")
+    return LogBuffer::OverflowPolicy::DROP;
+  if (*overflow == "sample")
+    return LogBuffer::OverflowPolicy::SAMPLE;
+  throw std::invalid_argument("Unknown log overflow policy: " + *overflow);
+}
+
+// Creates a buffer for output of the container if it opts into having
+// output dropped instead of being blocked when its log cannot be
+// written quickly enough.
+std::shared_ptr<LogBuffer> CreateLogBuffer(const InternedMap& annotations) {
+  std::optional<std::uint64_t> limit =
+      GetIntegerAnnotation(annotations, "scuba.nuxi.nl/log-buffer-bytes");
+  if (!limit)
+    return nullptr;
+  return std::make_shared<LogBuffer>(std::max<std::uint64_t>(*limit, 4096),
+                                     GetLogOverflowPolicy(annotations));
+}
+
+}  // namespace
+
+// Resources that need to be acquired before the container's process
+// can be spawned. The Argdata built from YAML or decoded from its
+// binary encoding references the file descriptors stored in here, so
+// they are kept together.
+class Container::Preparation {
+ public:
+  Preparation(const PodSandboxMetadata* pod_metadata,
+              const ContainerMetadata* container_metadata,
+              std::unique_ptr<FileDescriptor> executable,
+              std::unique_ptr<FileDescriptor> container_log,
+              Switchboard::Stub* containers_switchboard_handle)
+      : executable(std::move(executable)),
+        container_log(std::move(container_log)),
+        cpu_set_allocator(nullptr),
+        file_descriptor_factory(pod_metadata, container_metadata,
+                                this->container_log.get(), &mounts,
+                                containers_switchboard_handle, &error_factory),
+        argdata_factory(&file_descriptor_factory),
+        canonicalizing_factory(&argdata_factory),
+        argdata(nullptr) {
+  }
+
+  const std::unique_ptr<FileDescriptor> executable;
+  const std::unique_ptr<FileDescriptor> container_log;
+  std::unique_ptr<Cgroup> cgroup;
+  CpuSetAllocator* cpu_set_allocator;
+  // Whether the executable was in the page cache, if known.
+  std::optional<bool> executable_cached;
+  std::map<std::string, FileDescriptor, std::less<>> mounts;
+  std::vector<std::shared_ptr<FileDescriptor>> switchboards;
+
+  YAMLErrorFactory<const argdata_t*> error_factory;
+  YAMLFileDescriptorFactory file_descriptor_factory;
+  YAMLArgdataFactory argdata_factory;
+  YAMLCanonicalizingFactory<const argdata_t*> canonicalizing_factory;
+  std::unique_ptr<BinaryArgdata> binary_argdata;
+  const argdata_t* argdata;
+
+  Preparation(Preparation&) = delete;
+  void operator=(Preparation) = delete;
+};
+
+ProfiledMutex Container::child_loop_lock_("Container::child_loop_lock_");
 uv_loop_t Container::child_loop_;
+scuba::util::TimerWheel<Container*> Container::stop_deadlines_(
+    std::chrono::milliseconds(100), 1024);
+std::condition_variable_any Container::children_spawned_;
+std::size_t Container::running_children_ = 0;
 
-Container::Container(const ContainerConfig& config)
+Container::Container(std::string_view pod_sandbox_id,
+                     std::string_view container_id,
+                     const ContainerConfig& config,
+                     std::chrono::system_clock::time_point creation_time,
+                     EventLog* event_log, StateJournal* state_journal)
     : metadata_(config.metadata()),
-      image_(config.image()),
-      creation_time_(std::chrono::system_clock::now()),
+      image_(StringInterner::Default()->Intern(config.image().image())),
+      creation_time_(creation_time),
       labels_(config.labels()),
       annotations_(config.annotations()),
       mounts_(config.mounts()),
       log_path_(config.log_path()),
-      argdata_(config.argdata()),
+      argdata_(StringInterner::Default()->Intern(config.argdata())),
+      argdata_binary_(
+          StringInterner::Default()->Intern(config.argdata_binary())),
+      argdata_descriptors_(config.argdata_descriptors()),
+      resources_(config.linux().resources()),
+      pod_sandbox_id_(pod_sandbox_id),
+      container_id_(container_id),
+      event_log_(event_log),
+      state_journal_(state_journal),
+      output_(std::make_shared<LogRing>(kOutputCapacity)),
       container_state_(ContainerState::CONTAINER_CREATED) {
+  BinaryArgdata::Validate(*argdata_binary_, argdata_descriptors_, mounts_);
+
+  // Annotations are only used once the container is started. Reject
+  // malformed ones now, so that creating the container fails instead.
+  GetExclusiveCpuRequest(resources_, annotations_);
+  GetMaxLogLineLength(annotations_);
+  GetIntegerAnnotation(annotations_, "scuba.nuxi.nl/log-buffer-bytes");
+  GetLogOverflowPolicy(annotations_);
+
   // If this is the first container to be created, create an event loop
   // with which we can track termination of child processes.
   static std::once_flag child_loop_initialized;
   std::call_once(child_loop_initialized, []() {
     if (uv_loop_init(&child_loop_) != 0)
       std::terminate();
+    std::thread(ReapChildren_).detach();
   });
 }
 
 Container::~Container() {
+  // Release resources that were acquired for a process that never got
+  // started. This closes the pipe, causing the logging thread to stop.
+  if (preparation_.valid())
+    preparation_.wait();
+
   std::unique_lock lock(child_loop_lock_);
+  if (stop_deadline_)
+    stop_deadlines_.Cancel(*stop_deadline_);
   if (container_state_ != ContainerState::CONTAINER_CREATED) {
     // Child process spawned. Unregister process handle from the event loop.
     uv_close(reinterpret_cast<uv_handle_t*>(&child_process_),
@@ -91,10 +316,10 @@ Container::~Container() {
 
 void Container::GetInfo(runtime::Container* info) {
   *info->mutable_metadata() = metadata_;
-  *info->mutable_image() = image_;
-  info->set_image_ref(image_.image());
-  *info->mutable_labels() = labels_;
-  *info->mutable_annotations() = annotations_;
+  info->mutable_image()->set_image(*image_);
+  info->set_image_ref(*image_);
+  labels_.CopyTo(info->mutable_labels());
+  annotations_.CopyTo(info->mutable_annotations());
 
   std::unique_lock lock(child_loop_lock_);
   uv_run(&child_loop_, UV_RUN_NOWAIT);
@@ -105,11 +330,11 @@ void Container::GetInfo(runtime::Container* info) {
 
 void Container::GetStatus(ContainerStatus* status) {
   *status->mutable_metadata() = metadata_;
-  *status->mutable_image() = image_;
-  status->set_image_ref(image_.image());
-  *status->mutable_labels() = labels_;
-  *status->mutable_annotations() = annotations_;
-  *status->mutable_mounts() = mounts_;
+  status->mutable_image()->set_image(*image_);
+  status->set_image_ref(*image_);
+  labels_.CopyTo(status->mutable_labels());
+  annotations_.CopyTo(status->mutable_annotations());
+  mounts_.CopyTo(status->mutable_mounts());
   status->set_log_path(log_path_);
   // TODO(ed): reason, message.
 
@@ -135,15 +360,38 @@ void Container::GetStatus(ContainerStatus* status) {
   }
 }
 
+void Container::GetStats(runtime::ContainerStats* stats) {
+  runtime::ContainerAttributes* attributes = stats->mutable_attributes();
+  *attributes->mutable_metadata() = metadata_;
+  labels_.CopyTo(attributes->mutable_labels());
+  annotations_.CopyTo(attributes->mutable_annotations());
+
+  std::unique_lock start_lock(start_lock_);
+  if (!cgroup_)
+    return;
+  try {
+    std::uint64_t cpu_usage = cgroup_->GetCpuUsage();
+    std::uint64_t memory_working_set = cgroup_->GetMemoryWorkingSet();
+    auto now = std::chrono::system_clock::now();
+    std::int64_t timestamp =
+        std::chrono::nanoseconds(now.time_since_epoch()).count();
+    runtime::CpuUsage* cpu = stats->mutable_cpu();
+    cpu->set_timestamp(timestamp);
+    cpu->mutable_usage_core_nano_seconds()->set_value(cpu_usage);
+    runtime::MemoryUsage* memory = stats->mutable_memory();
+    memory->set_timestamp(timestamp);
+    memory->mutable_working_set_bytes()->set_value(memory_working_set);
+  } catch (const std::system_error& e) {
+    // Leave usage unset, so that listing stats of other containers
+    // still succeeds.
+  }
+}
+
 bool Container::MatchesFilter(std::optional<ContainerState> state,
                               const Map<std::string, std::string>& labels) {
-  // Perform subset match on labels. We can't use std::includes() here,
-  // as these maps use hashing.
-  for (const auto& label : labels) {
-    const auto& match = labels_.find(label.first);
-    if (match == labels_.end() || label.second != match->second)
-      return false;
-  }
+  // Perform subset match on labels.
+  if (!labels_.Includes(labels))
+    return false;
   if (!state)
     return true;
   std::unique_lock lock(child_loop_lock_);
@@ -151,75 +399,398 @@ bool Container::MatchesFilter(std::optional<ContainerState> state,
   return *state == container_state_;
 }
 
-void Container::Start(const PodSandboxMetadata& pod_metadata,
-                      const FileDescriptor& root_directory,
-                      const FileDescriptor& image_directory,
-                      const FileDescriptor& log_directory,
-                      Switchboard::Stub* containers_switchboard_handle) {
-  // Idempotence: container may already have been started.
-  std::unique_lock lock(child_loop_lock_);
-  if (container_state_ != ContainerState::CONTAINER_CREATED)
-    return;
+void Container::Prepare(const PodSandboxMetadata& pod_metadata,
+                        std::string_view log_directory,
+                        const FileDescriptor& root_directory,
+                        const FileDescriptor& image_directory,
+                        Switchboard::Stub* containers_switchboard_handle,
+                        const Cgroup* pod_cgroup,
+                        CpuSetAllocator* cpu_set_allocator,
+                        StartScheduler* start_scheduler) {
+  // Containers restored from the journal may have been started before.
+  {
+    std::unique_lock lock(child_loop_lock_);
+    if (container_state_ != ContainerState::CONTAINER_CREATED)
+      return;
+  }
+
+  std::unique_lock start_lock(start_lock_);
+  prepare_ = [this, &pod_metadata, log_directory{std::string(log_directory)},
+              &root_directory, &image_directory, containers_switchboard_handle,
+              pod_cgroup, cpu_set_allocator, start_scheduler]() {
+    // Acquiring resources is the expensive part of starting a container,
+    // so wait for our turn. Containers with a nonzero attempt number
+    // replace ones that terminated and take priority.
+    StartAdmission admission;
+    if (start_scheduler != nullptr)
+      admission = start_scheduler->Admit(pod_metadata.namespace_(),
+                                         metadata_.attempt() > 0);
+
+    // Turn provided log directory into a path relative to the root.
+    const char* relative_log_directory = log_directory.c_str();
+    while (*relative_log_directory == '/')
+      ++relative_log_directory;
+    int fd = openat(root_directory.get(), relative_log_directory,
+                    O_DIRECTORY | O_SEARCH);
+    if (fd < 0)
+      throw std::system_error(errno, std::system_category(), log_directory);
+    return Prepare_(pod_metadata, root_directory, image_directory,
+                    FileDescriptor(fd), containers_switchboard_handle,
+                    pod_cgroup, cpu_set_allocator);
+  };
+  preparation_ = std::async(std::launch::async, prepare_);
+}
+
+std::unique_ptr<Container::Preparation> Container::Prepare_(
+    const PodSandboxMetadata& pod_metadata,
+    const FileDescriptor& root_directory, const FileDescriptor& image_directory,
+    const FileDescriptor& log_directory,
+    Switchboard::Stub* containers_switchboard_handle,
+    const Cgroup* pod_cgroup, CpuSetAllocator* cpu_set_allocator) {
+  auto trace_detail = [this]() {
+    return NamingScheme::ComposePodSandboxContainerName(pod_sandbox_id_,
+                                                        container_id_);
+  };
 
   // Open the executable.
   // TODO(ed): This should validate the path.
   // TODO(ed): Compute executable checksum.
+  TraceSpan open_executable_span("Container::OpenExecutable", trace_detail);
   int executable_fd =
-      openat(image_directory.get(), image_.image().c_str(), O_EXEC);
+      openat(image_directory.get(), image_->c_str(), O_EXEC);
   if (executable_fd < 0)
-    throw std::system_error(errno, std::system_category(), image_.image());
-  FileDescriptor executable(executable_fd);
+    throw std::system_error(errno, std::system_category(), *image_);
+  auto executable = std::make_unique<FileDescriptor>(executable_fd);
+  // Read the executable into the page cache while the remaining
+  // resources are acquired, so the process doesn't stall on it.
+  std::optional<bool> executable_cached = IsFileCached(executable_fd);
+  PrefetchFile(executable_fd);
+  open_executable_span.End();
 
-  std::unique_ptr<FileDescriptor> container_log =
-      OpenContainerLog_(log_directory);
+  TraceSpan open_log_span("Container::OpenContainerLog", trace_detail);
+  auto container_log = OpenContainerLog_(log_directory);
+  open_log_span.End();
+  auto preparation = std::make_unique<Preparation>(
+      &pod_metadata, &metadata_, std::move(executable),
+      std::move(container_log), containers_switchboard_handle);
+  preparation->executable_cached = executable_cached;
 
   // Obtain file descriptors for every mount.
-  std::map<std::string, FileDescriptor, std::less<>> mounts;
+  TraceSpan open_mounts_span("Container::OpenMounts", trace_detail);
   for (const auto& mount : mounts_) {
     // TODO(ed): Pick proper O_ACCMODE.
-    const char* host_path = mount.host_path().c_str();
+    const char* host_path = mount.host_path->c_str();
     while (*host_path == '/')
       ++host_path;
     int mount_fd = openat(root_directory.get(), host_path, O_SEARCH);
     if (mount_fd < 0)
-      throw std::system_error(errno, std::system_category(), mount.host_path());
-    mounts.emplace(mount.container_path(), mount_fd);
+      throw std::system_error(errno, std::system_category(), *mount.host_path);
+    preparation->mounts.emplace(*mount.container_path, mount_fd);
+  }
+  open_mounts_span.End();
+
+  // Create the control group in which the process is placed.
+  if (pod_cgroup != nullptr) {
+    TraceSpan create_cgroup_span("Container::CreateCgroup", trace_detail);
+    preparation->cgroup = std::make_unique<Cgroup>(pod_cgroup, container_id_);
+    preparation->cgroup->SetResources(resources_);
+    preparation->cpu_set_allocator = cpu_set_allocator;
+  }
+
+  // Binary Argdata only needs to have its placeholders replaced by
+  // file descriptors, which have been validated upon creation.
+  if (!argdata_binary_->empty()) {
+    TraceSpan decode_argdata_span("Container::DecodeArgdata", trace_detail);
+    std::vector<int> fds;
+    for (const ArgdataDescriptor& descriptor : argdata_descriptors_) {
+      switch (descriptor.descriptor_case()) {
+        case ArgdataDescriptor::kContainerLog:
+          fds.push_back(preparation->container_log->get());
+          break;
+        case ArgdataDescriptor::kMount:
+          fds.push_back(
+              preparation->mounts.find(descriptor.mount())->second.get());
+          break;
+        case ArgdataDescriptor::kServer: {
+          std::map<std::string, std::string> labels(
+              descriptor.server().labels().begin(),
+              descriptor.server().labels().end());
+          fds.push_back(preparation->switchboards
+                            .emplace_back(ConstrainServerSwitchboard(
+                                containers_switchboard_handle, pod_metadata,
+                                metadata_, labels))
+                            ->get());
+          break;
+        }
+        default:
+          throw std::invalid_argument("Argdata descriptor has no type");
+      }
+    }
+    preparation->binary_argdata =
+        std::make_unique<BinaryArgdata>(*argdata_binary_, std::move(fds));
+    preparation->argdata = preparation->binary_argdata->Get();
+    return preparation;
   }
 
   // Convert Argdata in YAML form to serialized data.
-  YAMLErrorFactory<const argdata_t*> error_factory;
-  YAMLFileDescriptorFactory file_descriptor_factory(
-      &pod_metadata, &metadata_, container_log.get(), &mounts,
-      containers_switchboard_handle, &error_factory);
-  YAMLArgdataFactory argdata_factory(&file_descriptor_factory);
-  YAMLCanonicalizingFactory<const argdata_t*> canonicalizing_factory(
-      &argdata_factory);
-  YAMLBuilder<const argdata_t*> builder(&canonicalizing_factory);
-  std::istringstream argdata_stream(argdata_);
-  const argdata_t* argdata = builder.Build(&argdata_stream);
+  TraceSpan build_argdata_span("Container::BuildArgdata", trace_detail);
+  YAMLBuilder<const argdata_t*> builder(&preparation->canonicalizing_factory);
+  std::istringstream argdata_stream(*argdata_);
+  preparation->argdata = builder.Build(&argdata_stream);
+  return preparation;
+}
+
+void Container::Start() {
+  auto trace_detail = [this]() {
+    return NamingScheme::ComposePodSandboxContainerName(pod_sandbox_id_,
+                                                        container_id_);
+  };
+  TraceSpan span("Container::Start", trace_detail);
+  auto start = std::chrono::steady_clock::now();
+
+  // Idempotence: container may already have been started.
+  std::unique_lock start_lock(start_lock_);
+  {
+    std::unique_lock lock(child_loop_lock_);
+    if (container_state_ != ContainerState::CONTAINER_CREATED)
+      return;
+  }
+
+  // Wait for the resources that are being acquired in the background.
+  // If acquiring them failed, retry in the foreground, as the failure
+  // may have been transient.
+  if (!prepare_)
+    throw std::logic_error("Container has not been prepared");
+  TraceSpan wait_span("Container::WaitForPreparation", trace_detail);
+  std::unique_ptr<Preparation> preparation;
+  if (preparation_.valid()) {
+    try {
+      preparation = preparation_.get();
+    } catch (const std::exception& e) {
+      // Retried below.
+    }
+  }
+  if (!preparation)
+    preparation = prepare_();
+  wait_span.End();
+
+  // Place the process on CPUs assigned exclusively if it requests them
+  // and they are available, or on the shared CPUs otherwise.
+  std::optional<CpuSetLease> cpu_set_lease;
+  if (preparation->cpu_set_allocator != nullptr) {
+    TraceSpan place_span("Container::PlaceOnCpus", trace_detail);
+    if (std::size_t count = GetExclusiveCpuRequest(resources_, annotations_);
+        count > 0)
+      cpu_set_lease = preparation->cpu_set_allocator->Allocate(count);
+    if (cpu_set_lease)
+      preparation->cgroup->SetCpuSet(cpu_set_lease->GetCpus(),
+                                     cpu_set_lease->GetMems());
+    else
+      preparation->cgroup->SetCpuSet(
+          preparation->cpu_set_allocator->GetSharedCpus(), "");
+  }
 
   // Create a process handle through the event loop.
+  std::unique_lock lock(child_loop_lock_);
   child_process_.data = this;
+  TraceSpan spawn_span("Container::Spawn", trace_detail);
+  auto spawn_start = std::chrono::steady_clock::now();
   if (int error = program_spawn(
-          &child_loop_, &child_process_, executable.get(), argdata,
+          &child_loop_, &child_process_, preparation->executable->get(),
+          preparation->argdata,
           [](uv_process_t* process, int64_t exit_status, int term_signal) {
             Container* container = reinterpret_cast<Container*>(process->data);
             container->container_state_ = ContainerState::CONTAINER_EXITED;
             container->finish_time_ = std::chrono::system_clock::now();
             container->exit_code_ =
                 term_signal == 0 ? exit_status : term_signal;
+            container->cpu_set_lease_.reset();
+            --running_children_;
+            if (container->stop_deadline_) {
+              stop_deadlines_.Cancel(*container->stop_deadline_);
+              container->stop_deadline_.reset();
+            }
+            container->child_exited_.notify_all();
+            container->event_log_->Publish(
+                EventType::CONTAINER_EXITED, container->pod_sandbox_id_,
+                NamingScheme::ComposePodSandboxContainerName(
+                    container->pod_sandbox_id_, container->container_id_),
+                container->exit_code_);
+            if (container->state_journal_ != nullptr) {
+              Record record;
+              auto exited = record.mutable_container_exited();
+              exited->set_pod_sandbox_id(container->pod_sandbox_id_);
+              exited->set_container_id(container->container_id_);
+              exited->set_finished_at(ToJournalTime(container->finish_time_));
+              exited->set_exit_code(container->exit_code_);
+              container->state_journal_->Append(record);
+            }
           });
-      error != 0)
+      error != 0) {
+    spawn_failures->Increment();
     throw std::system_error(error, std::system_category(),
                             "Failed to spawn process");
+  }
+  spawn_duration->Observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - spawn_start)
+                              .count());
+  spawn_span.End();
+  if (preparation->executable_cached)
+    (*preparation->executable_cached ? warm_start_duration
+                                     : cold_start_duration)
+        ->Observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count());
+
+  // The process can only be moved into its control group once it has
+  // been spawned. Keep it running if that fails, as it has already
+  // been started at this point.
+  if (preparation->cgroup) {
+    try {
+      preparation->cgroup->AddProcess(child_process_.pid);
+    } catch (const std::system_error& e) {
+      std::cerr << "Failed to apply resource limits to " << container_id_
+                << ": " << e.what() << std::endl;
+    }
+    cgroup_ = std::move(preparation->cgroup);
+  }
+  cpu_set_lease_ = std::move(cpu_set_lease);
   container_state_ = ContainerState::CONTAINER_RUNNING;
+  ++running_children_;
+  children_spawned_.notify_one();
   start_time_ = std::chrono::system_clock::now();
+  event_log_->Publish(EventType::CONTAINER_STARTED, pod_sandbox_id_,
+                      NamingScheme::ComposePodSandboxContainerName(
+                          pod_sandbox_id_, container_id_));
+  if (state_journal_ != nullptr) {
+    Record record;
+    auto started = record.mutable_container_started();
+    started->set_pod_sandbox_id(pod_sandbox_id_);
+    started->set_container_id(container_id_);
+    started->set_started_at(ToJournalTime(start_time_));
+    state_journal_->Append(record);
+  }
 }
 
 void Container::Stop(std::int64_t timeout) {
+  RequestStop(timeout);
+  WaitUntilStopped();
+}
+
+void Container::RequestStop(std::int64_t timeout) {
   std::unique_lock lock(child_loop_lock_);
-  if (container_state_ != ContainerState::CONTAINER_CREATED)
+  uv_run(&child_loop_, UV_RUN_NOWAIT);
+  if (container_state_ != ContainerState::CONTAINER_RUNNING)
+    return;
+
+  if (timeout <= 0) {
     uv_process_kill(&child_process_, SIGKILL);
+  } else {
+    // Request graceful termination and schedule a forceful kill. Only
+    // move the deadline forward if the container is already stopping.
+    auto deadline = util::TimerWheel<Container*>::Clock::now() +
+                    std::chrono::seconds(timeout);
+    if (!stop_deadline_ || deadline < stop_deadline_->deadline()) {
+      if (stop_deadline_)
+        stop_deadlines_.Cancel(*stop_deadline_);
+      stop_deadline_ = stop_deadlines_.Schedule(deadline, this);
+    }
+    uv_process_kill(&child_process_, SIGTERM);
+  }
+}
+
+void Container::WaitUntilStopped() {
+  // The background thread runs the event loop until the process has
+  // terminated.
+  std::unique_lock lock(child_loop_lock_);
+  child_exited_.wait(lock, [this]() {
+    return container_state_ != ContainerState::CONTAINER_RUNNING;
+  });
+}
+
+void Container::SetSharedCpus(std::string_view cpus) {
+  std::unique_lock start_lock(start_lock_);
+  if (!cgroup_)
+    return;
+  {
+    std::unique_lock lock(child_loop_lock_);
+    if (container_state_ != ContainerState::CONTAINER_RUNNING ||
+        cpu_set_lease_)
+      return;
+  }
+  try {
+    cgroup_->SetCpuSet(cpus, "");
+  } catch (const std::system_error& e) {
+    std::cerr << "Failed to update CPUs of " << container_id_ << ": "
+              << e.what() << std::endl;
+  }
+}
+
+void Container::RestoreStarted(
+    std::chrono::system_clock::time_point start_time) {
+  std::unique_lock lock(child_loop_lock_);
+  container_state_ = ContainerState::CONTAINER_EXITED;
+  start_time_ = start_time;
+  finish_time_ = std::chrono::system_clock::now();
+  exit_code_ = 255;
+}
+
+void Container::RestoreExited(
+    std::chrono::system_clock::time_point finish_time,
+    std::int32_t exit_code) {
+  std::unique_lock lock(child_loop_lock_);
+  container_state_ = ContainerState::CONTAINER_EXITED;
+  finish_time_ = finish_time;
+  exit_code_ = exit_code;
+}
+
+void Container::Snapshot(std::vector<Record>* records) {
+  auto created = records->emplace_back().mutable_container_created();
+  created->set_pod_sandbox_id(pod_sandbox_id_);
+  created->set_container_id(container_id_);
+  created->set_created_at(ToJournalTime(creation_time_));
+  ContainerConfig* config = created->mutable_config();
+  *config->mutable_metadata() = metadata_;
+  config->mutable_image()->set_image(*image_);
+  labels_.CopyTo(config->mutable_labels());
+  annotations_.CopyTo(config->mutable_annotations());
+  mounts_.CopyTo(config->mutable_mounts());
+  config->set_log_path(log_path_);
+  config->set_argdata(*argdata_);
+  config->set_argdata_binary(*argdata_binary_);
+  *config->mutable_argdata_descriptors() = argdata_descriptors_;
+  *config->mutable_linux()->mutable_resources() = resources_;
+
+  std::unique_lock lock(child_loop_lock_);
+  if (container_state_ != ContainerState::CONTAINER_CREATED) {
+    auto started = records->emplace_back().mutable_container_started();
+    started->set_pod_sandbox_id(pod_sandbox_id_);
+    started->set_container_id(container_id_);
+    started->set_started_at(ToJournalTime(start_time_));
+  }
+  if (container_state_ == ContainerState::CONTAINER_EXITED) {
+    auto exited = records->emplace_back().mutable_container_exited();
+    exited->set_pod_sandbox_id(pod_sandbox_id_);
+    exited->set_container_id(container_id_);
+    exited->set_finished_at(ToJournalTime(finish_time_));
+    exited->set_exit_code(exit_code_);
+  }
+}
+
+void Container::ReapChildren_() {
+  LockProfiler::SetOperation("Container::ReapChildren");
+  std::unique_lock lock(child_loop_lock_);
+  for (;;) {
+    children_spawned_.wait(lock, []() { return running_children_ > 0; });
+    uv_run(&child_loop_, UV_RUN_NOWAIT);
+    stop_deadlines_.Advance(util::TimerWheel<Container*>::Clock::now(),
+                            [](Container* container) {
+                              container->stop_deadline_.reset();
+                              uv_process_kill(&container->child_process_,
+                                              SIGKILL);
+                            });
+    children_spawned_.wait_for(lock, stop_deadlines_.tick());
+  }
 }
 
 std::unique_ptr<FileDescriptor> Container::OpenContainerLog_(
@@ -240,44 +811,77 @@ std::unique_ptr<FileDescriptor> Container::OpenContainerLog_(
   auto readfd = std::make_unique<FileDescriptor>(pipefds[0]);
   auto writefd = std::make_unique<FileDescriptor>(pipefds[1]);
 
+  // If requested, drain the pipe on a separate thread that never waits
+  // for the log file to be written.
+  std::shared_ptr<LogBuffer> buffer = CreateLogBuffer(annotations_);
+  std::size_t max_line_length = GetMaxLogLineLength(annotations_);
+  if (buffer) {
+    std::thread([readfd{std::move(readfd)}, output{output_}, buffer]() {
+      for (;;) {
+        char input_buffer[4096];
+        ssize_t input_length =
+            read(readfd->get(), input_buffer, sizeof(input_buffer));
+        if (input_length <= 0) {
+          output->Close();
+          buffer->Close(input_length == 0 ? 0 : errno);
+          return;
+        }
+        log_bytes->Increment(input_length);
+        output->Write(std::string_view(input_buffer, input_length));
+        buffer->Write(std::string_view(input_buffer, input_length));
+      }
+    })
+        .detach();
+  }
+
   // Read messages from the pipe and write them into the log file in the
   // format that Kubernetes expects.
-  std::thread([logfd{std::move(logfd)}, readfd{std::move(readfd)}]() mutable {
+  std::thread([logfd{std::move(logfd)}, readfd{std::move(readfd)},
+               output{output_}, buffer{std::move(buffer)},
+               max_line_length]() mutable {
     // Startup message.
     fd_streambuf logstreambuf(std::move(logfd));
     std::ostream logfile(&logstreambuf);
-    logfile << ISO8601Timestamp() << " stderr --- Logging started" << std::endl;
+    logfile << ISO8601Timestamp() << " stderr F --- Logging started"
+            << std::endl;
 
     // Processing of logs written by the container.
-    ssize_t input_length;
-    bool line_start = true;
-    for (;;) {
-      char input_buffer[4096];
-      input_length = read(readfd->get(), input_buffer, sizeof(input_buffer));
-      if (input_length <= 0)
-        break;
-
-      std::optional<ISO8601Timestamp> now;
-      for (char c : std::string_view(input_buffer, input_length)) {
-        if (line_start) {
-          if (!now)
-            now = ISO8601Timestamp();
-          logfile << *now << " stdout ";
-          line_start = false;
+    LogFramer framer(&logfile, max_line_length);
+    int error = 0;
+    if (buffer) {
+      LogBuffer::Chunk chunk;
+      while (buffer->Read(&chunk)) {
+        framer.Write(chunk.data);
+        if (chunk.dropped_bytes > 0) {
+          framer.Finish();
+          logfile << ISO8601Timestamp() << " stderr F --- Dropped "
+                  << chunk.dropped_bytes << " bytes ("
+                  << chunk.dropped_lines << " lines) of output" << std::endl;
+        }
+        logfile << std::flush;
+      }
+      error = buffer->GetError();
+    } else {
+      for (;;) {
+        char input_buffer[4096];
+        ssize_t input_length =
+            read(readfd->get(), input_buffer, sizeof(input_buffer));
+        if (input_length <= 0) {
+          error = input_length == 0 ? 0 : errno;
+          break;
         }
-        logfile << c;
-        if (c == '\n')
-          line_start = true;
+        log_bytes->Increment(input_length);
+        output->Write(std::string_view(input_buffer, input_length));
+        framer.Write(std::string_view(input_buffer, input_length));
+        logfile << std::flush;
       }
-      logfile << std::flush;
+      output->Close();
     }
-    if (!line_start)
-      logfile << std::endl;
+    framer.Finish();
 
     // Termination message.
-    logfile << ISO8601Timestamp() << " stderr --- Logging stopped: "
-            << (input_length == 0 ? "Pipe closed by container"
-                                  : std::strerror(errno))
+    logfile << ISO8601Timestamp() << " stderr F --- Logging stopped: "
+            << (error == 0 ? "Pipe closed by container" : std::strerror(error))
             << std::endl;
   })
       .detach();
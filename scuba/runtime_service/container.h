@@ -8,70 +8,174 @@
 #include <uv.h>
 
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "arpc++/arpc++.h"
 #include "flower/protocol/switchboard.ad.h"
 #include "google/protobuf/map.h"
 #include "google/protobuf/repeated_field.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/cpu_set_allocator.h"
+#include "scuba/runtime_service/interned_config.h"
+#include "scuba/runtime_service/journal.pb.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/start_scheduler.h"
+#include "scuba/util/lock_profiler.h"
+#include "scuba/util/timer_wheel.h"
 
 namespace scuba {
 namespace runtime_service {
 
+class Cgroup;
+class EventLog;
 class IPAddressLease;
+class StateJournal;
 
 class Container {
  public:
-  explicit Container(const runtime::ContainerConfig& config);
+  Container(std::string_view pod_sandbox_id, std::string_view container_id,
+            const runtime::ContainerConfig& config,
+            std::chrono::system_clock::time_point creation_time,
+            EventLog* event_log, StateJournal* state_journal);
   ~Container();
 
+  std::string_view GetId() const {
+    return container_id_;
+  }
+  const runtime::ContainerMetadata& GetMetadata() const {
+    return metadata_;
+  }
   void GetInfo(runtime::Container* info);
   void GetStatus(runtime::ContainerStatus* status);
+  // Reports resource usage, which is only known for containers whose
+  // process has been placed in a control group.
+  void GetStats(runtime::ContainerStats* stats);
+  // Recent output of the container, shared with attached clients.
+  std::shared_ptr<LogRing> GetOutput() const {
+    return output_;
+  }
 
   bool MatchesFilter(
       std::optional<runtime::ContainerState> state,
       const google::protobuf::Map<std::string, std::string>& labels);
 
-  void Start(const runtime::PodSandboxMetadata& pod_metadata,
-             const arpc::FileDescriptor& root_directory,
-             const arpc::FileDescriptor& image_directory,
-             const arpc::FileDescriptor& log_directory,
-             flower::protocol::switchboard::Switchboard::Stub*
-                 containers_switchboard_handle);
+  // Starts acquiring the resources needed to spawn the container's
+  // process in the background, so that Start() only needs to wait for
+  // them to become available. If the pod sandbox has a control group,
+  // the process is placed in a nested one with the requested limits.
+  // A CPU set allocator optionally assigns CPUs to it when started. A
+  // start scheduler optionally limits how many containers acquire
+  // their resources concurrently.
+  void Prepare(const runtime::PodSandboxMetadata& pod_metadata,
+               std::string_view log_directory,
+               const arpc::FileDescriptor& root_directory,
+               const arpc::FileDescriptor& image_directory,
+               flower::protocol::switchboard::Switchboard::Stub*
+                   containers_switchboard_handle,
+               const Cgroup* pod_cgroup, CpuSetAllocator* cpu_set_allocator,
+               StartScheduler* start_scheduler);
+  void Start();
+  // Requests graceful termination of the process, forcefully killing it
+  // if it hasn't terminated after the timeout (in seconds) has passed.
+  // Blocks until the process has terminated.
   void Stop(std::int64_t timeout);
+  // Non-blocking variants of Stop(), allowing many containers to be
+  // signalled first and waited for afterwards.
+  void RequestStop(std::int64_t timeout);
+  void WaitUntilStopped();
+
+  // Moves a running process that has not been assigned CPUs exclusively
+  // to the CPUs that are currently shared.
+  void SetSharedCpus(std::string_view cpus);
+
+  // Functions for restoring state from the journal. Processes don't
+  // survive restarts of the runtime service, meaning that containers
+  // that were started are always restored as exited.
+  void RestoreStarted(std::chrono::system_clock::time_point start_time);
+  void RestoreExited(std::chrono::system_clock::time_point finish_time,
+                     std::int32_t exit_code);
+  void Snapshot(std::vector<journal::Record>* records);
 
   Container(Container&) = delete;
   void operator=(Container) = delete;
 
  private:
+  class Preparation;
+
+  std::unique_ptr<Preparation> Prepare_(
+      const runtime::PodSandboxMetadata& pod_metadata,
+      const arpc::FileDescriptor& root_directory,
+      const arpc::FileDescriptor& image_directory,
+      const arpc::FileDescriptor& log_directory,
+      flower::protocol::switchboard::Switchboard::Stub*
+          containers_switchboard_handle,
+      const Cgroup* pod_cgroup, CpuSetAllocator* cpu_set_allocator);
   std::unique_ptr<arpc::FileDescriptor> OpenContainerLog_(
       const arpc::FileDescriptor& log_directory);
+  static void ReapChildren_();
 
-  // Data that should be returned through ContainerStatus.
+  // Data that should be returned through ContainerStatus. Strings that
+  // tend to be identical between replicas are interned.
   const runtime::ContainerMetadata metadata_;
-  const runtime::ImageSpec image_;
+  const InternedString image_;
   const std::chrono::system_clock::time_point creation_time_;
-  const google::protobuf::Map<std::string, std::string> labels_;
-  const google::protobuf::Map<std::string, std::string> annotations_;
-  const google::protobuf::RepeatedPtrField<runtime::Mount> mounts_;
+  const InternedMap labels_;
+  const InternedMap annotations_;
+  const InternedMounts mounts_;
   const std::string log_path_;
-  const std::string argdata_;
+  const InternedString argdata_;
+  const InternedString argdata_binary_;
+  const google::protobuf::RepeatedPtrField<runtime::ArgdataDescriptor>
+      argdata_descriptors_;
+  const runtime::LinuxContainerResources resources_;
+
+  // Identifiers and logs used for reporting state changes.
+  const std::string pod_sandbox_id_;
+  const std::string container_id_;
+  EventLog* const event_log_;
+  StateJournal* const state_journal_;
+  const std::shared_ptr<LogRing> output_;
 
   // Event loop that is used for managing subprocess lifetime.
-  static std::mutex child_loop_lock_;
+  static util::ProfiledMutex child_loop_lock_;
   static uv_loop_t child_loop_;
 
+  // Deadlines at which processes that are being stopped gracefully
+  // need to be killed forcefully. A background thread runs the event
+  // loop and expires deadlines while there are processes running, so
+  // that termination is reported even if nobody is waiting for it.
+  static util::TimerWheel<Container*> stop_deadlines_;
+  static std::condition_variable_any children_spawned_;
+  static std::size_t running_children_;
+
   // Fields modified by event loop callbacks, guarded by the loop's lock.
   uv_process_t child_process_;
+  std::condition_variable_any child_exited_;
+  std::optional<util::TimerWheel<Container*>::Handle> stop_deadline_;
   runtime::ContainerState container_state_;
   std::chrono::system_clock::time_point start_time_;
   std::chrono::system_clock::time_point finish_time_;
   std::int32_t exit_code_;
+  // CPUs assigned exclusively, released as soon as the process exits.
+  std::optional<CpuSetLease> cpu_set_lease_;
+
+  // Resources for spawning the process, acquired in the background.
+  // Declared last, so that the background work has completed before
+  // any of the fields above are destroyed.
+  std::mutex start_lock_;
+  std::unique_ptr<Cgroup> cgroup_;
+  std::function<std::unique_ptr<Preparation>()> prepare_;
+  std::future<std::unique_ptr<Preparation>> preparation_;
 };
 
 }  // namespace runtime_service
@@ -0,0 +1,180 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/cpu_set_allocator.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "scuba/util/metrics.h"
+
+using scuba::runtime_service::CpuSetAllocator;
+using scuba::runtime_service::CpuSetLease;
+using scuba::util::Counter;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+Counter* const allocation_failures = MetricsRegistry::Default()->GetCounter(
+    "scuba_cpu_set_allocation_failures_total",
+    "Number of containers that requested exclusive CPUs, but got placed "
+    "on shared CPUs.");
+
+}  // namespace
+
+CpuSetLease::CpuSetLease(CpuSetLease&& lease) {
+  allocator_ = lease.allocator_;
+  node_ = lease.node_;
+  cpus_ = std::move(lease.cpus_);
+  lease.allocator_ = nullptr;
+}
+
+CpuSetLease::~CpuSetLease() {
+  if (allocator_ != nullptr)
+    allocator_->Deallocate(node_, cpus_);
+}
+
+CpuSetLease& CpuSetLease::operator=(CpuSetLease&& lease) {
+  if (allocator_ != nullptr)
+    allocator_->Deallocate(node_, cpus_);
+  allocator_ = lease.allocator_;
+  node_ = lease.node_;
+  cpus_ = std::move(lease.cpus_);
+  lease.allocator_ = nullptr;
+  return *this;
+}
+
+std::string CpuSetLease::GetCpus() const {
+  return CpuSetAllocator::FormatList(cpus_);
+}
+
+CpuSetAllocator::CpuSetAllocator(const std::vector<std::string>& nodes,
+                                 std::string_view available_cpus)
+    : unlisted_cpus_(ParseList(available_cpus)), free_(0) {
+  for (const std::string& node : nodes) {
+    std::vector<unsigned int> cpus = ParseList(node);
+    std::size_t size = cpus.size();
+    for (unsigned int cpu : cpus) {
+      auto match = std::lower_bound(unlisted_cpus_.begin(),
+                                    unlisted_cpus_.end(), cpu);
+      if (match != unlisted_cpus_.end() && *match == cpu)
+        unlisted_cpus_.erase(match);
+    }
+    free_ += size;
+    nodes_.push_back(Node{std::move(cpus), std::vector<bool>(size), size});
+  }
+  if (free_ == 0 && unlisted_cpus_.empty())
+    throw std::invalid_argument("No CPUs available to containers");
+}
+
+std::optional<CpuSetLease> CpuSetAllocator::Allocate(std::size_t count) {
+  std::unique_lock lock(lock_);
+  std::optional<std::size_t> best;
+  if (count < free_ || (count == free_ && !unlisted_cpus_.empty()))
+    for (std::size_t i = 0; i < nodes_.size(); ++i)
+      if (nodes_[i].free >= count &&
+          (!best || nodes_[i].free < nodes_[*best].free))
+        best = i;
+  if (!best) {
+    allocation_failures->Increment();
+    return {};
+  }
+
+  Node& node = nodes_[*best];
+  std::vector<unsigned int> cpus;
+  for (std::size_t i = 0; cpus.size() < count; ++i) {
+    if (!node.in_use[i]) {
+      node.in_use[i] = true;
+      cpus.push_back(node.cpus[i]);
+    }
+  }
+  node.free -= count;
+  free_ -= count;
+  return CpuSetLease(this, *best, std::move(cpus));
+}
+
+void CpuSetAllocator::Deallocate(std::size_t node_index,
+                                 const std::vector<unsigned int>& cpus) {
+  std::unique_lock lock(lock_);
+  Node& node = nodes_[node_index];
+  for (unsigned int cpu : cpus) {
+    auto match = std::lower_bound(node.cpus.begin(), node.cpus.end(), cpu);
+    node.in_use[match - node.cpus.begin()] = false;
+  }
+  node.free += cpus.size();
+  free_ += cpus.size();
+  deallocated_ = true;
+  deallocated_cv_.notify_all();
+}
+
+std::string CpuSetAllocator::GetSharedCpus() {
+  std::vector<unsigned int> cpus;
+  {
+    std::unique_lock lock(lock_);
+    for (const Node& node : nodes_)
+      for (std::size_t i = 0; i < node.cpus.size(); ++i)
+        if (!node.in_use[i])
+          cpus.push_back(node.cpus[i]);
+  }
+  if (cpus.empty())
+    return FormatList(unlisted_cpus_);
+  std::sort(cpus.begin(), cpus.end());
+  return FormatList(cpus);
+}
+
+void CpuSetAllocator::WaitForDeallocation() {
+  std::unique_lock lock(lock_);
+  deallocated_cv_.wait(lock, [this]() { return deallocated_; });
+  deallocated_ = false;
+}
+
+std::vector<unsigned int> CpuSetAllocator::ParseList(std::string_view list) {
+  std::vector<unsigned int> cpus;
+  while (!list.empty()) {
+    std::string_view range = list.substr(0, list.find(','));
+    list.remove_prefix(std::min(range.size() + 1, list.size()));
+    std::size_t dash = range.find('-');
+    std::string first(range.substr(0, dash));
+    std::string last(dash == std::string_view::npos ? first
+                                                    : range.substr(dash + 1));
+    char* first_end;
+    char* last_end;
+    unsigned long first_cpu = std::strtoul(first.c_str(), &first_end, 10);
+    unsigned long last_cpu = std::strtoul(last.c_str(), &last_end, 10);
+    if (first.empty() || last.empty() || *first_end != '\0' ||
+        *last_end != '\0' || first_cpu > last_cpu)
+      throw std::invalid_argument("Invalid CPU list: " + std::string(range));
+    for (unsigned long cpu = first_cpu; cpu <= last_cpu; ++cpu)
+      cpus.push_back(cpu);
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::string CpuSetAllocator::FormatList(const std::vector<unsigned int>& cpus) {
+  // Collapse consecutive CPUs into ranges.
+  std::string list;
+  for (std::size_t i = 0; i < cpus.size();) {
+    std::size_t j = i + 1;
+    while (j < cpus.size() && cpus[j] == cpus[j - 1] + 1)
+      ++j;
+    if (!list.empty())
+      list += ',';
+    list += std::to_string(cpus[i]);
+    if (j - i > 1)
+      list += '-' + std::to_string(cpus[j - 1]);
+    i = j;
+  }
+  return list;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_CPU_SET_ALLOCATOR_H
+#define SCUBA_RUNTIME_SERVICE_CPU_SET_ALLOCATOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace scuba {
+namespace runtime_service {
+
+class CpuSetAllocator;
+
+class CpuSetLease {
+ public:
+  CpuSetLease() : allocator_(nullptr) {
+  }
+
+  CpuSetLease(CpuSetAllocator* allocator, std::size_t node,
+              std::vector<unsigned int> cpus)
+      : allocator_(allocator), node_(node), cpus_(std::move(cpus)) {
+  }
+
+  CpuSetLease(CpuSetLease&& lease);
+  CpuSetLease& operator=(CpuSetLease&& lease);
+  ~CpuSetLease();
+
+  // Values for cpuset.cpus and cpuset.mems.
+  std::string GetCpus() const;
+  std::string GetMems() const {
+    return std::to_string(node_);
+  }
+
+ private:
+  CpuSetAllocator* allocator_;
+  std::size_t node_;
+  std::vector<unsigned int> cpus_;
+
+  CpuSetLease(const CpuSetLease&) = delete;
+  CpuSetLease& operator=(const CpuSetLease&) = delete;
+};
+
+// Allocator of CPUs that are assigned exclusively to containers. CPUs
+// are grouped by NUMA node, and allocations never span nodes, so that
+// memory can be bound to the node as well. CPUs that are not listed
+// are never handed out, keeping them available to the runtime service
+// itself and the rest of the system.
+class CpuSetAllocator {
+ public:
+  // Takes a list of CPUs for every NUMA node, using the same syntax as
+  // cpuset.cpus (e.g., "0-3,8-11"), and the list of all CPUs on which
+  // containers may run. Throws std::invalid_argument if no CPUs are
+  // available to containers at all.
+  CpuSetAllocator(const std::vector<std::string>& nodes,
+                  std::string_view available_cpus);
+
+  // Allocates CPUs on the node that has the fewest free CPUs left that
+  // can still satisfy the request, limiting fragmentation. If all
+  // available CPUs are listed, the last one is never handed out, so
+  // that other containers have a place to run.
+  std::optional<CpuSetLease> Allocate(std::size_t count);
+  void Deallocate(std::size_t node, const std::vector<unsigned int>& cpus);
+
+  // Returns the CPUs that are not assigned exclusively, on which all
+  // other containers are placed. If all listed CPUs are assigned, these
+  // are the CPUs that are not listed. Never overlaps with a lease and
+  // is never empty.
+  std::string GetSharedCpus();
+  // Blocks until CPUs have been deallocated since the previous call.
+  // Leases are released when processes terminate, at which point the
+  // set of shared CPUs cannot be updated directly.
+  void WaitForDeallocation();
+
+  static std::vector<unsigned int> ParseList(std::string_view list);
+  static std::string FormatList(const std::vector<unsigned int>& cpus);
+
+ private:
+  struct Node {
+    std::vector<unsigned int> cpus;
+    std::vector<bool> in_use;
+    std::size_t free;
+  };
+
+  // CPUs that are available, but not listed.
+  std::vector<unsigned int> unlisted_cpus_;
+
+  std::mutex lock_;
+  std::condition_variable deallocated_cv_;
+  bool deallocated_ = false;
+  std::vector<Node> nodes_;
+  std::size_t free_;
+
+  CpuSetAllocator(CpuSetAllocator&) = delete;
+  void operator=(CpuSetAllocator) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/debug_service.h"
+
+#include <sstream>
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/debug.grpc.pb.h"
+#include "scuba/util/lock_profiler.h"
+#include "scuba/util/trace.h"
+
+using grpc::ServerContext;
+using grpc::Status;
+using scuba::debug::GetLockProfileRequest;
+using scuba::debug::GetLockProfileResponse;
+using scuba::debug::GetTraceRequest;
+using scuba::debug::GetTraceResponse;
+using scuba::debug::SetLockProfilingRequest;
+using scuba::debug::SetLockProfilingResponse;
+using scuba::debug::SetTracingRequest;
+using scuba::debug::SetTracingResponse;
+using scuba::runtime_service::DebugService;
+
+Status DebugService::SetTracing(ServerContext* context,
+                                const SetTracingRequest* request,
+                                SetTracingResponse* response) {
+  tracer_->SetEnabled(request->enabled());
+  return Status::OK;
+}
+
+Status DebugService::GetTrace(ServerContext* context,
+                              const GetTraceRequest* request,
+                              GetTraceResponse* response) {
+  std::ostringstream trace;
+  tracer_->WriteChromeTrace(&trace);
+  response->set_chrome_trace(trace.str());
+  return Status::OK;
+}
+
+Status DebugService::SetLockProfiling(ServerContext* context,
+                                      const SetLockProfilingRequest* request,
+                                      SetLockProfilingResponse* response) {
+  lock_profiler_->SetEnabled(request->enabled());
+  return Status::OK;
+}
+
+Status DebugService::GetLockProfile(ServerContext* context,
+                                    const GetLockProfileRequest* request,
+                                    GetLockProfileResponse* response) {
+  std::ostringstream text;
+  lock_profiler_->WriteText(&text);
+  response->set_text(text.str());
+  return Status::OK;
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_DEBUG_SERVICE_H
+#define SCUBA_RUNTIME_SERVICE_DEBUG_SERVICE_H
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/debug.grpc.pb.h"
+
+namespace scuba {
+namespace util {
+
+class LockProfiler;
+class Tracer;
+
+}  // namespace util
+
+namespace runtime_service {
+
+class DebugService final : public debug::DebugService::Service {
+ public:
+  DebugService(util::Tracer* tracer, util::LockProfiler* lock_profiler)
+      : tracer_(tracer), lock_profiler_(lock_profiler) {
+  }
+
+  grpc::Status SetTracing(grpc::ServerContext* context,
+                          const debug::SetTracingRequest* request,
+                          debug::SetTracingResponse* response) override;
+  grpc::Status GetTrace(grpc::ServerContext* context,
+                        const debug::GetTraceRequest* request,
+                        debug::GetTraceResponse* response) override;
+  grpc::Status SetLockProfiling(
+      grpc::ServerContext* context,
+      const debug::SetLockProfilingRequest* request,
+      debug::SetLockProfilingResponse* response) override;
+  grpc::Status GetLockProfile(grpc::ServerContext* context,
+                              const debug::GetLockProfileRequest* request,
+                              debug::GetLockProfileResponse* response) override;
+
+ private:
+  util::Tracer* const tracer_;
+  util::LockProfiler* const lock_profiler_;
+
+  DebugService(DebugService&) = delete;
+  void operator=(DebugService) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,64 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/event_log.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scuba/runtime_service/events.pb.h"
+
+using scuba::events::Event;
+using scuba::events::EventType;
+using scuba::runtime_service::EventLog;
+
+void EventLog::Publish(EventType type, std::string_view pod_sandbox_id,
+                       std::string_view container_id, std::int32_t exit_code) {
+  Event event;
+  event.set_timestamp(std::chrono::nanoseconds(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count());
+  event.set_type(type);
+  event.set_pod_sandbox_id(std::string(pod_sandbox_id));
+  event.set_container_id(std::string(container_id));
+  event.set_exit_code(exit_code);
+
+  std::unique_lock lock(lock_);
+  event.set_sequence(++last_sequence_);
+  if (events_.size() >= capacity_)
+    events_.pop_front();
+  events_.push_back(std::move(event));
+  published_.notify_all();
+}
+
+bool EventLog::Read(std::uint64_t after_sequence,
+                    std::chrono::milliseconds timeout,
+                    std::vector<Event>* events) {
+  // Sequence numbers are not preserved across restarts. A sequence
+  // number beyond the last one handed out was obtained from an earlier
+  // instance of the runtime, meaning events may have been missed.
+  std::unique_lock lock(lock_);
+  if (after_sequence > last_sequence_)
+    return false;
+  published_.wait_for(lock, timeout,
+                      [this, after_sequence]() {
+                        return last_sequence_ > after_sequence;
+                      });
+
+  // Events are stored with consecutive sequence numbers, meaning the
+  // offset of the first event to return can be computed directly.
+  std::uint64_t first_sequence = last_sequence_ - events_.size() + 1;
+  if (after_sequence != 0 && after_sequence + 1 < first_sequence)
+    return false;
+  for (std::uint64_t i = after_sequence < first_sequence
+                             ? 0
+                             : after_sequence + 1 - first_sequence;
+       i < events_.size(); ++i)
+    events->push_back(events_[i]);
+  return true;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_EVENT_LOG_H
+#define SCUBA_RUNTIME_SERVICE_EVENT_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "scuba/runtime_service/events.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Bounded log of recent changes to pod sandboxes and containers, which
+// are pushed to clients of the event service.
+class EventLog {
+ public:
+  explicit EventLog(std::size_t capacity) : capacity_(capacity) {
+  }
+
+  void Publish(events::EventType type, std::string_view pod_sandbox_id,
+               std::string_view container_id = {},
+               std::int32_t exit_code = 0);
+
+  // Appends events with a sequence number greater than the one
+  // provided. Waits for at most the timeout if no such events exist.
+  // Returns false if events have already been discarded, or if the
+  // sequence number was not handed out by this log.
+  bool Read(std::uint64_t after_sequence, std::chrono::milliseconds timeout,
+            std::vector<events::Event>* events);
+
+ private:
+  const std::size_t capacity_;
+
+  std::mutex lock_;
+  std::condition_variable published_;
+  std::uint64_t last_sequence_ = 0;
+  std::deque<events::Event> events_;
+
+  EventLog(EventLog&) = delete;
+  void operator=(EventLog) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,42 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/event_service.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/events.grpc.pb.h"
+
+using grpc::ServerContext;
+using grpc::ServerWriter;
+using grpc::Status;
+using grpc::StatusCode;
+using scuba::events::Event;
+using scuba::events::WatchEventsRequest;
+using scuba::runtime_service::EventService;
+
+Status EventService::WatchEvents(ServerContext* context,
+                                 const WatchEventsRequest* request,
+                                 ServerWriter<Event>* writer) {
+  std::uint64_t sequence = request->after_sequence();
+  while (!context->IsCancelled()) {
+    // Wait for new events in bounded intervals, so that cancellation of
+    // the call is noticed even if no events occur.
+    std::vector<Event> events;
+    if (!event_log_->Read(sequence, std::chrono::seconds(1), &events))
+      return {StatusCode::OUT_OF_RANGE,
+              "Events have been discarded or the runtime has restarted. "
+              "Relist and watch again."};
+    for (const Event& event : events) {
+      if (!writer->Write(event))
+        return Status::OK;
+      sequence = event.sequence();
+    }
+  }
+  return {StatusCode::CANCELLED, "Call cancelled by client"};
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_EVENT_SERVICE_H
+#define SCUBA_RUNTIME_SERVICE_EVENT_SERVICE_H
+
+#include "grpc++/grpc++.h"
+#include "scuba/runtime_service/events.grpc.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+class EventLog;
+
+class EventService final : public events::EventService::Service {
+ public:
+  explicit EventService(EventLog* event_log) : event_log_(event_log) {
+  }
+
+  grpc::Status WatchEvents(
+      grpc::ServerContext* context, const events::WatchEventsRequest* request,
+      grpc::ServerWriter<events::Event>* writer) override;
+
+ private:
+  EventLog* const event_log_;
+
+  EventService(EventService&) = delete;
+  void operator=(EventService) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
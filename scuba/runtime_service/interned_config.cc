@@ -0,0 +1,112 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/interned_config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/map.h"
+#include "google/protobuf/repeated_field.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+
+using google::protobuf::Map;
+using google::protobuf::RepeatedPtrField;
+using scuba::runtime_service::InternedMap;
+using scuba::runtime_service::InternedMounts;
+using scuba::runtime_service::InternedString;
+using scuba::runtime_service::StringInterner;
+
+StringInterner* StringInterner::Default() {
+  static StringInterner* interner = new StringInterner();
+  return interner;
+}
+
+InternedString StringInterner::Intern(std::string_view value) {
+  std::unique_lock lock(lock_);
+  auto match = strings_.find(value);
+  if (match != strings_.end()) {
+    if (InternedString string = match->second.lock())
+      return string;
+    // The string is about to be removed. Replace it by a new one.
+    strings_.erase(match);
+  }
+
+  InternedString string(new std::string(value),
+                        [this](const std::string* string) {
+                          Remove_(string);
+                          delete string;
+                        });
+  strings_.emplace(*string, string);
+  return string;
+}
+
+void StringInterner::Remove_(const std::string* string) {
+  // Only remove the entry if it hasn't been replaced in the meantime.
+  std::unique_lock lock(lock_);
+  auto match = strings_.find(*string);
+  if (match != strings_.end() && match->first.data() == string->data())
+    strings_.erase(match);
+}
+
+InternedMap::InternedMap(const Map<std::string, std::string>& map) {
+  StringInterner* interner = StringInterner::Default();
+  entries_.reserve(map.size());
+  for (const auto& entry : map)
+    entries_.emplace_back(interner->Intern(entry.first),
+                          interner->Intern(entry.second));
+  std::sort(entries_.begin(), entries_.end(),
+            [](const auto& a, const auto& b) { return *a.first < *b.first; });
+}
+
+const std::string* InternedMap::Find(std::string_view key) const {
+  auto match = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                [](const auto& entry, std::string_view key) {
+                                  return *entry.first < key;
+                                });
+  if (match == entries_.end() || *match->first != key)
+    return nullptr;
+  return match->second.get();
+}
+
+bool InternedMap::Includes(const Map<std::string, std::string>& map) const {
+  for (const auto& entry : map) {
+    const std::string* value = Find(entry.first);
+    if (value == nullptr || *value != entry.second)
+      return false;
+  }
+  return true;
+}
+
+void InternedMap::CopyTo(Map<std::string, std::string>* map) const {
+  map->clear();
+  for (const auto& entry : entries_)
+    (*map)[*entry.first] = *entry.second;
+}
+
+InternedMounts::InternedMounts(const RepeatedPtrField<runtime::Mount>& mounts) {
+  StringInterner* interner = StringInterner::Default();
+  mounts_.reserve(mounts.size());
+  for (const auto& mount : mounts)
+    mounts_.push_back(Mount{interner->Intern(mount.container_path()),
+                            interner->Intern(mount.host_path()),
+                            mount.readonly(), mount.selinux_relabel()});
+}
+
+void InternedMounts::CopyTo(RepeatedPtrField<runtime::Mount>* mounts) const {
+  mounts->Clear();
+  for (const Mount& mount : mounts_) {
+    runtime::Mount* copy = mounts->Add();
+    copy->set_container_path(*mount.container_path);
+    copy->set_host_path(*mount.host_path);
+    copy->set_readonly(mount.readonly);
+    copy->set_selinux_relabel(mount.selinux_relabel);
+  }
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_INTERNED_CONFIG_H
+#define SCUBA_RUNTIME_SERVICE_INTERNED_CONFIG_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/map.h"
+#include "google/protobuf/repeated_field.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Immutable string that is shared by all objects that store the same
+// value, such as the keys and most values of labels of replicas.
+using InternedString = std::shared_ptr<const std::string>;
+
+// Table of strings that are currently in use. Strings are removed from
+// the table once they are no longer referenced, meaning the interner
+// must outlive them.
+class StringInterner {
+ public:
+  StringInterner() = default;
+
+  // Interner shared by all components of a process. It is never
+  // destroyed, as strings may still be in use while the process exits.
+  static StringInterner* Default();
+
+  InternedString Intern(std::string_view value);
+
+ private:
+  void Remove_(const std::string* string);
+
+  // Keys refer to the strings themselves.
+  std::mutex lock_;
+  std::unordered_map<std::string_view, std::weak_ptr<const std::string>>
+      strings_;
+
+  StringInterner(StringInterner&) = delete;
+  void operator=(StringInterner) = delete;
+};
+
+// Compact, immutable replacement for the maps of labels and annotations
+// of pod sandboxes and containers. Entries are kept sorted by key.
+class InternedMap {
+ public:
+  explicit InternedMap(
+      const google::protobuf::Map<std::string, std::string>& map);
+
+  // Returns the value of an entry, or null if it does not exist.
+  const std::string* Find(std::string_view key) const;
+  // Returns true if all entries of a map are also present in this one.
+  bool Includes(const google::protobuf::Map<std::string, std::string>& map)
+      const;
+  void CopyTo(google::protobuf::Map<std::string, std::string>* map) const;
+
+ private:
+  std::vector<std::pair<InternedString, InternedString>> entries_;
+};
+
+// Compact, immutable replacement for the list of mounts of a container.
+class InternedMounts {
+ public:
+  explicit InternedMounts(
+      const google::protobuf::RepeatedPtrField<runtime::Mount>& mounts);
+
+  struct Mount {
+    InternedString container_path;
+    InternedString host_path;
+    bool readonly;
+    bool selinux_relabel;
+  };
+
+  std::vector<Mount>::const_iterator begin() const {
+    return mounts_.begin();
+  }
+  std::vector<Mount>::const_iterator end() const {
+    return mounts_.end();
+  }
+  void CopyTo(google::protobuf::RepeatedPtrField<runtime::Mount>* mounts)
+      const;
+
+ private:
+  std::vector<Mount> mounts_;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -4,17 +4,59 @@
 
 #include "scuba/runtime_service/ip_address_allocator.h"
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
+
+#include "scuba/util/metrics.h"
 
 using scuba::runtime_service::IPAddressAllocator;
 using scuba::runtime_service::IPAddressLease;
+using scuba::util::Counter;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+constexpr std::size_t npos = ~std::size_t(0);
+constexpr std::uint64_t full = ~std::uint64_t(0);
+
+Counter* const allocations = MetricsRegistry::Default()->GetCounter(
+    "scuba_ip_address_allocations_total",
+    "Number of IP addresses allocated to pod sandboxes.");
+Counter* const allocation_failures = MetricsRegistry::Default()->GetCounter(
+    "scuba_ip_address_allocation_failures_total",
+    "Number of times no IP address could be allocated.");
+Counter* const deallocations = MetricsRegistry::Default()->GetCounter(
+    "scuba_ip_address_deallocations_total",
+    "Number of IP addresses released by pod sandboxes.");
+
+// Fast pseudo-random number generator (xorshift64*) that is used to
+// spread out allocated addresses. Every thread has its own state, which
+// is seeded from std::random_device once.
+std::uint64_t NextRandom() {
+  thread_local std::uint64_t state = []() {
+    std::random_device random_device;
+    return std::uint64_t(random_device()) << 32 | random_device() | 1;
+  }();
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1d;
+}
+
+}  // namespace
 
 IPAddressLease::IPAddressLease(IPAddressLease&& lease) {
   allocator_ = lease.allocator_;
@@ -58,49 +100,195 @@ bool IPAddressAllocator::SetRange(std::string_view range) {
       c > 255 || s3 != '.' || d > 255 || s4 != '/' || prefixlen > 32)
     return false;
 
+  // Refuse ranges for which the bitmaps would become excessively large.
+  if (prefixlen < 8)
+    return false;
+
+  std::uint32_t first, last;
   if (prefixlen > 30) {
     // Prefix length of 31 or 32, meaning there are no network and
     // broadcast addresses.
     std::uint32_t mask = std::uint32_t(~0) << (32 - prefixlen);
     std::uint32_t base = (a << 24 | b << 16 | c << 8 | d) & mask;
-    first_ = base;
-    last_ = base | ~mask;
+    first = base;
+    last = base | ~mask;
   } else {
     // Prefix length of 30 or less, meaning we should keep the network
     // and broadcast addresses free.
     std::uint32_t mask = ~(std::uint32_t(~0) >> prefixlen);
     std::uint32_t base = (a << 24 | b << 16 | c << 8 | d) & mask;
-    first_ = base | 0x00000001;
-    last_ = base | (0xfffffffe & ~mask);
+    first = base | 0x00000001;
+    last = base | (0xfffffffe & ~mask);
+  }
+
+  std::unique_lock lock(range_lock_);
+  if (first == first_ && last == last_)
+    return true;
+
+  // Create bitmaps for the new range, having a bit per address at the
+  // lowest level. Bits past the end of each level are set, so that
+  // they never get allocated.
+  std::vector<Level> levels;
+  std::size_t bits = std::size_t(last - first) + 1;
+  do {
+    std::size_t words = (bits + 63) / 64;
+    auto& level = levels.emplace_back(
+        Level{bits, std::make_unique<std::atomic<std::uint64_t>[]>(words)});
+    if (bits % 64 != 0)
+      level.words[words - 1] = full << (bits % 64);
+    bits = words;
+  } while (bits > 1);
+
+  // Preserve addresses of existing leases that lie within the new range.
+  std::swap(levels, levels_);
+  std::uint32_t old_first = first_;
+  first_ = first;
+  last_ = last;
+  in_use_ = 0;
+  if (!levels.empty()) {
+    const Level& old_leaves = levels.front();
+    for (std::size_t i = 0; i < old_leaves.bits; ++i) {
+      std::uint32_t address = old_first + i;
+      if ((old_leaves.words[i / 64] & std::uint64_t(1) << (i % 64)) != 0 &&
+          address >= first_ && address <= last_) {
+        std::size_t index = address - first_;
+        std::uint64_t bit = std::uint64_t(1) << (index % 64);
+        if ((levels_[0].words[index / 64] |= bit) == full)
+          MarkFull_(1, index / 64);
+        ++in_use_;
+      }
+    }
   }
   return true;
 }
 
 IPAddressLease IPAddressAllocator::Allocate() {
-  if (first_ > last_)
+  std::shared_lock lock(range_lock_);
+  if (first_ > last_) {
+    allocation_failures->Increment();
     throw std::runtime_error("No IP address range configured");
+  }
+
+  // Start searching at a random address, so that addresses are not
+  // reused immediately after being released. Wrap around once.
+  const Level& leaves = levels_.front();
+  std::size_t start = NextRandom() % leaves.bits;
+  for (std::size_t index = FindUnused_(0, start);;
+       index = FindUnused_(0, index)) {
+    if (index == npos) {
+      if (start == 0)
+        break;
+      index = FindUnused_(0, 0);
+      start = 0;
+      if (index == npos)
+        break;
+    }
 
-  // First try to allocate an address at random.
-  std::uint32_t address;
-  std::uniform_int_distribution<std::uint32_t> dist(first_, last_);
-  for (int i = 0; i < 100; ++i) {
-    address = dist(random_device_);
-    if (used_.find(address) == used_.end()) {
-      used_.insert(address);
-      return IPAddressLease(this, address);
+    // Attempt to claim the address. Another thread may have claimed it
+    // in the meantime, in which case the search continues.
+    std::uint64_t bit = std::uint64_t(1) << (index % 64);
+    std::uint64_t old = leaves.words[index / 64].fetch_or(bit);
+    if ((old & bit) == 0) {
+      if ((old | bit) == full)
+        MarkFull_(1, index / 64);
+      ++in_use_;
+      allocations->Increment();
+      return IPAddressLease(this, first_ + index);
     }
   }
 
-  // Fall back to doing a full sweep of the address range.
-  for (address = first_; address >= first_ && address <= last_; ++address) {
-    if (used_.find(address) == used_.end()) {
-      used_.insert(address);
-      return IPAddressLease(this, address);
+  // The upper levels of the bitmap are only hints, as they are updated
+  // separately from the lowest level. If they claim the range is full
+  // while it isn't, fall back to doing a full sweep.
+  if (in_use_ < leaves.bits) {
+    for (std::size_t index = 0; index < leaves.bits; ++index) {
+      std::uint64_t bit = std::uint64_t(1) << (index % 64);
+      std::uint64_t old = leaves.words[index / 64].fetch_or(bit);
+      if ((old & bit) == 0) {
+        if ((old | bit) == full)
+          MarkFull_(1, index / 64);
+        ++in_use_;
+        allocations->Increment();
+        return IPAddressLease(this, first_ + index);
+      }
     }
   }
+  allocation_failures->Increment();
   throw std::runtime_error("No unused IP addresses available");
 }
 
+IPAddressLease IPAddressAllocator::Reserve(std::uint32_t address) {
+  std::shared_lock lock(range_lock_);
+  if (address < first_ || address > last_)
+    throw std::out_of_range("IP address lies outside of the range");
+  std::size_t index = address - first_;
+  std::uint64_t bit = std::uint64_t(1) << (index % 64);
+  std::uint64_t old = levels_[0].words[index / 64].fetch_or(bit);
+  if ((old & bit) != 0)
+    throw std::runtime_error("IP address is already in use");
+  if ((old | bit) == full)
+    MarkFull_(1, index / 64);
+  ++in_use_;
+  allocations->Increment();
+  return IPAddressLease(this, address);
+}
+
 void IPAddressAllocator::Deallocate(std::uint32_t address) {
-  used_.erase(address);
+  std::shared_lock lock(range_lock_);
+  if (address < first_ || address > last_)
+    return;
+  std::size_t index = address - first_;
+  std::uint64_t bit = std::uint64_t(1) << (index % 64);
+  std::uint64_t old = levels_[0].words[index / 64].fetch_and(~bit);
+  if ((old & bit) != 0) {
+    if (old == full)
+      MarkNotFull_(1, index / 64);
+    --in_use_;
+    deallocations->Increment();
+  }
+}
+
+std::size_t IPAddressAllocator::FindUnused_(std::size_t level,
+                                            std::size_t start) const {
+  const Level& current = levels_[level];
+  while (start < current.bits) {
+    std::size_t word = start / 64;
+    std::uint64_t unused = ~current.words[word].load() & full << (start % 64);
+    if (unused != 0)
+      return word * 64 + __builtin_ctzll(unused);
+
+    // No unused bits left in this word. Use the level above to skip
+    // over any subsequent words that are full.
+    if (level + 1 == levels_.size())
+      return npos;
+    std::size_t next = FindUnused_(level + 1, word + 1);
+    if (next == npos)
+      return npos;
+    start = next * 64;
+  }
+  return npos;
+}
+
+void IPAddressAllocator::MarkFull_(std::size_t level, std::size_t index) {
+  for (; level < levels_.size(); index /= 64, ++level) {
+    std::uint64_t bit = std::uint64_t(1) << (index % 64);
+    std::uint64_t old = levels_[level].words[index / 64].fetch_or(bit);
+
+    // The word in the level below may have become non-full due to a
+    // concurrent deallocation. Undo the change if that's the case.
+    if (levels_[level - 1].words[index] != full) {
+      levels_[level].words[index / 64].fetch_and(~bit);
+      return;
+    }
+    if ((old | bit) != full)
+      return;
+  }
+}
+
+void IPAddressAllocator::MarkNotFull_(std::size_t level, std::size_t index) {
+  for (; level < levels_.size(); index /= 64, ++level) {
+    std::uint64_t bit = std::uint64_t(1) << (index % 64);
+    if (levels_[level].words[index / 64].fetch_and(~bit) != full)
+      return;
+  }
 }
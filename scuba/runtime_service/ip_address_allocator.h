@@ -5,10 +5,14 @@
 #ifndef SCUBA_RUNTIME_SERVICE_IP_ADDRESS_ALLOCATOR_H
 #define SCUBA_RUNTIME_SERVICE_IP_ADDRESS_ALLOCATOR_H
 
-#include <random>
-#include <set>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace scuba {
 namespace runtime_service {
@@ -28,6 +32,9 @@ class IPAddressLease {
   IPAddressLease& operator=(IPAddressLease&& lease);
   ~IPAddressLease();
 
+  std::uint32_t GetAddress() const {
+    return address_;
+  }
   std::string GetString() const;
 
  private:
@@ -38,21 +45,40 @@ class IPAddressLease {
   IPAddressLease& operator=(const IPAddressLease&) = delete;
 };
 
+// Allocator of IP addresses within a range, using a hierarchy of
+// bitmaps. Every bit in the lowest level corresponds with an address.
+// Every bit in the levels above indicates whether the corresponding
+// word in the level below is full, so that free addresses can be found
+// by skipping over full regions using count-trailing-zeros.
+//
+// Allocation and deallocation only use atomic operations on the
+// bitmaps. They only exclude changes to the range itself.
 class IPAddressAllocator {
  public:
-  IPAddressAllocator() : first_(1), last_(0) {
+  IPAddressAllocator() : first_(1), last_(0), in_use_(0) {
   }
 
   bool SetRange(std::string_view range);
   IPAddressLease Allocate();
+  // Allocates a specific address, used to restore existing leases.
+  IPAddressLease Reserve(std::uint32_t address);
   void Deallocate(std::uint32_t address);
 
  private:
-  std::uint32_t first_;  // First allocatable address.
-  std::uint32_t last_;   // Last allocatable address.
-
-  std::random_device random_device_;  // Random address picker.
-  std::set<std::uint32_t> used_;      // Addresses currently in use.
+  struct Level {
+    std::size_t bits;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words;
+  };
+
+  std::size_t FindUnused_(std::size_t level, std::size_t start) const;
+  void MarkFull_(std::size_t level, std::size_t index);
+  void MarkNotFull_(std::size_t level, std::size_t index);
+
+  std::shared_mutex range_lock_;  // Acquired exclusively by SetRange().
+  std::uint32_t first_;           // First allocatable address.
+  std::uint32_t last_;            // Last allocatable address.
+  std::vector<Level> levels_;     // Bitmaps of addresses in use.
+  std::atomic<std::size_t> in_use_;
 
   IPAddressAllocator(IPAddressAllocator&) = delete;
   void operator=(IPAddressAllocator) = delete;
@@ -0,0 +1,114 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/log_buffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "scuba/util/metrics.h"
+
+using scuba::runtime_service::LogBuffer;
+using scuba::util::Counter;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+Counter* const dropped_bytes = MetricsRegistry::Default()->GetCounter(
+    "scuba_container_log_dropped_bytes_total",
+    "Number of bytes of output dropped, as logs could not be written "
+    "quickly enough.");
+Counter* const dropped_lines = MetricsRegistry::Default()->GetCounter(
+    "scuba_container_log_dropped_lines_total",
+    "Number of lines of output dropped, as logs could not be written "
+    "quickly enough.");
+
+}  // namespace
+
+void LogBuffer::Write(std::string_view data) {
+  std::unique_lock lock(lock_);
+  bool was_empty = chunks_.empty();
+  while (!data.empty()) {
+    // Decide whether to keep a line when it starts, so that partial
+    // lines are only written if the buffer fills up while copying.
+    if (line_start_) {
+      dropping_line_ = !KeepLine_();
+      line_start_ = false;
+    }
+    std::size_t newline = data.find('\n');
+    std::size_t length =
+        newline == std::string_view::npos ? data.size() : newline + 1;
+    std::string_view line = data.substr(0, length);
+    data.remove_prefix(length);
+    line_start_ = newline != std::string_view::npos;
+
+    if (!dropping_line_) {
+      // Append the line to the last chunk, unless that is followed by
+      // a gap.
+      if (chunks_.empty() || chunks_.back().dropped_bytes > 0)
+        chunks_.emplace_back();
+      std::size_t copied = std::min(line.size(), limit_ - size_);
+      chunks_.back().data.append(line.data(), copied);
+      size_ += copied;
+      line.remove_prefix(copied);
+      if (!line.empty())
+        dropping_line_ = true;
+    }
+    if (dropping_line_)
+      Drop_(line);
+  }
+  if (was_empty && !chunks_.empty())
+    written_.notify_one();
+}
+
+void LogBuffer::Close(int error) {
+  std::unique_lock lock(lock_);
+  closed_ = true;
+  error_ = error;
+  written_.notify_one();
+}
+
+bool LogBuffer::Read(Chunk* chunk) {
+  std::unique_lock lock(lock_);
+  written_.wait(lock, [this]() { return !chunks_.empty() || closed_; });
+  if (chunks_.empty())
+    return false;
+  *chunk = std::move(chunks_.front());
+  chunks_.pop_front();
+  size_ -= chunk->data.size();
+  return true;
+}
+
+int LogBuffer::GetError() {
+  std::unique_lock lock(lock_);
+  return error_;
+}
+
+bool LogBuffer::KeepLine_() {
+  if (size_ >= limit_)
+    return false;
+  if (policy_ == OverflowPolicy::SAMPLE && size_ >= limit_ / 2)
+    return lines_sampled_++ % kSampleInterval == 0;
+  lines_sampled_ = 0;
+  return true;
+}
+
+void LogBuffer::Drop_(std::string_view data) {
+  if (data.empty())
+    return;
+  if (chunks_.empty())
+    chunks_.emplace_back();
+  Chunk& chunk = chunks_.back();
+  chunk.dropped_bytes += data.size();
+  dropped_bytes->Increment(data.size());
+  if (data.back() == '\n') {
+    ++chunk.dropped_lines;
+    dropped_lines->Increment();
+  }
+}
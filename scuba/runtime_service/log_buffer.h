@@ -0,0 +1,90 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_LOG_BUFFER_H
+#define SCUBA_RUNTIME_SERVICE_LOG_BUFFER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace scuba {
+namespace runtime_service {
+
+// Bounded queue between the thread draining the output of a container
+// and the thread writing it to the log file. Writing to the buffer
+// never blocks, so that a stalled disk doesn't stall the container.
+// Output that doesn't fit is dropped in units of whole lines, and the
+// gaps are reported to the reader.
+class LogBuffer {
+ public:
+  enum class OverflowPolicy {
+    // Drop all lines once the buffer is full.
+    DROP,
+    // Keep one in every kSampleInterval lines once the buffer is half
+    // full, and drop all lines once it is full.
+    SAMPLE,
+  };
+  static constexpr std::uint64_t kSampleInterval = 16;
+
+  // Output that is read from the buffer, followed by a gap of output
+  // that was dropped.
+  struct Chunk {
+    std::string data;
+    std::uint64_t dropped_bytes = 0;
+    std::uint64_t dropped_lines = 0;
+  };
+
+  LogBuffer(std::size_t limit, OverflowPolicy policy)
+      : limit_(limit),
+        policy_(policy),
+        size_(0),
+        dropping_line_(false),
+        line_start_(true),
+        lines_sampled_(0),
+        closed_(false),
+        error_(0) {
+  }
+
+  void Write(std::string_view data);
+  // Marks the end of the output, providing the error that caused it,
+  // or zero if the container closed its end of the pipe.
+  void Close(int error);
+
+  // Blocks until output or a gap is available. Returns false once the
+  // buffer has been closed and drained.
+  bool Read(Chunk* chunk);
+  int GetError();
+
+ private:
+  bool KeepLine_();
+  void Drop_(std::string_view data);
+
+  const std::size_t limit_;
+  const OverflowPolicy policy_;
+
+  std::mutex lock_;
+  std::condition_variable written_;
+  std::deque<Chunk> chunks_;
+  std::size_t size_;
+  // Whether the rest of the current line is dropped, and whether the
+  // next byte starts a new line.
+  bool dropping_line_;
+  bool line_start_;
+  std::uint64_t lines_sampled_;
+  bool closed_;
+  int error_;
+
+  LogBuffer(LogBuffer&) = delete;
+  void operator=(LogBuffer) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,67 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/log_framer.h"
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "scuba/runtime_service/iso8601_timestamp.h"
+
+using scuba::runtime_service::ISO8601Timestamp;
+using scuba::runtime_service::LogFramer;
+
+void LogFramer::Write(std::string_view data) {
+  std::optional<ISO8601Timestamp> now;
+  while (!data.empty()) {
+    // Only look for the end of the line within the space that remains.
+    std::size_t space = max_line_length_ - line_.size();
+    std::string_view window = data.substr(0, space + 1);
+    std::size_t newline = window.find('\n');
+    if (newline != std::string_view::npos) {
+      // Complete line. Avoid copying it if nothing was held back.
+      if (line_.empty()) {
+        WriteRecord_(&now, 'F', window.substr(0, newline));
+      } else {
+        line_.append(window.substr(0, newline));
+        WriteRecord_(&now, 'F', line_);
+        line_.clear();
+      }
+      data.remove_prefix(newline + 1);
+    } else if (window.size() > space) {
+      // Line exceeds the maximum length.
+      if (line_.empty()) {
+        WriteRecord_(&now, 'P', window.substr(0, space));
+      } else {
+        line_.append(window.substr(0, space));
+        WriteRecord_(&now, 'P', line_);
+        line_.clear();
+      }
+      data.remove_prefix(space);
+    } else {
+      line_.append(window);
+      data = {};
+    }
+  }
+}
+
+void LogFramer::Finish() {
+  if (!line_.empty()) {
+    std::optional<ISO8601Timestamp> now;
+    WriteRecord_(&now, 'F', line_);
+    line_.clear();
+  }
+}
+
+void LogFramer::WriteRecord_(std::optional<ISO8601Timestamp>* now, char tag,
+                             std::string_view line) {
+  if (!*now)
+    *now = ISO8601Timestamp();
+  *output_ << **now << " stdout " << tag << ' ';
+  output_->write(line.data(), line.size());
+  output_->put('\n');
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_LOG_FRAMER_H
+#define SCUBA_RUNTIME_SERVICE_LOG_FRAMER_H
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "scuba/runtime_service/iso8601_timestamp.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Converts the output of a container to the log format that Kubernetes
+// expects, prefixing every line with a timestamp, the stream name and
+// a tag indicating whether the line is complete. Lines longer than the
+// maximum length are split into partial records, so that neither this
+// framer nor readers of the log need to buffer them as a whole.
+class LogFramer {
+ public:
+  // Same default as the kubelet uses for its own log files.
+  static constexpr std::size_t kDefaultMaxLineLength = 16 * 1024;
+
+  LogFramer(std::ostream* output, std::size_t max_line_length)
+      : output_(output), max_line_length_(max_line_length) {
+  }
+
+  // Frames a chunk of output. Incomplete lines are held back until they
+  // are completed or reach the maximum length. Records written for the
+  // same chunk share a single timestamp.
+  void Write(std::string_view data);
+  // Writes the last line if it was incomplete.
+  void Finish();
+
+ private:
+  void WriteRecord_(std::optional<ISO8601Timestamp>* now, char tag,
+                    std::string_view line);
+
+  std::ostream* const output_;
+  const std::size_t max_line_length_;
+  std::string line_;
+
+  LogFramer(LogFramer&) = delete;
+  void operator=(LogFramer) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
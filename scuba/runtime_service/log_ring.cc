@@ -0,0 +1,106 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/log_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+using scuba::runtime_service::LogRing;
+
+LogRing::LogRing(std::size_t capacity)
+    : capacity_(capacity),
+      reserved_(0),
+      end_(0),
+      closed_(false),
+      waiting_readers_(0) {
+  assert((capacity & (capacity - 1)) == 0 &&
+         "Capacity must be a power of two");
+}
+
+void LogRing::Write(std::string_view data) {
+  // Only the tail of the data fits if it exceeds the capacity. Offsets
+  // still account for all of it, so readers can tell data got dropped.
+  if (data.empty())
+    return;
+  if (!buffer_)
+    buffer_.reset(new char[capacity_]);
+  std::uint64_t end = end_.load(std::memory_order_relaxed);
+  std::uint64_t new_end = end + data.size();
+  if (data.size() > capacity_)
+    data.remove_prefix(data.size() - capacity_);
+
+  // Announce which data is about to be overwritten before doing so.
+  reserved_.store(new_end, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::size_t position = (new_end - data.size()) & (capacity_ - 1);
+  std::size_t first = std::min(data.size(), capacity_ - position);
+  std::memcpy(buffer_.get() + position, data.data(), first);
+  std::memcpy(buffer_.get(), data.data() + first, data.size() - first);
+  end_.store(new_end, std::memory_order_release);
+
+  // Wake up readers that have caught up. The fence pairs with the
+  // increment of the number of waiting readers, so that either the
+  // writer observes the reader or the reader observes the new data.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_readers_.load(std::memory_order_relaxed) > 0) {
+    std::unique_lock lock(lock_);
+    written_.notify_all();
+  }
+}
+
+void LogRing::Close() {
+  closed_.store(true);
+  std::unique_lock lock(lock_);
+  written_.notify_all();
+}
+
+std::uint64_t LogRing::Read(std::uint64_t offset,
+                            std::chrono::milliseconds timeout,
+                            std::string* data) {
+  std::uint64_t end = end_.load();
+  if (offset >= end && !closed_.load()) {
+    waiting_readers_.fetch_add(1);
+    std::unique_lock lock(lock_);
+    written_.wait_for(lock, timeout, [this, offset, &end]() {
+      end = end_.load();
+      return end > offset || closed_.load();
+    });
+    waiting_readers_.fetch_sub(1);
+  }
+
+  // Skip data that has already been overwritten.
+  if (end > capacity_)
+    offset = std::max(offset, end - capacity_);
+  if (offset >= end)
+    return offset;
+  std::size_t size = end - offset;
+  std::size_t old_size = data->size();
+  data->resize(old_size + size);
+  std::size_t position = offset & (capacity_ - 1);
+  std::size_t first = std::min(size, capacity_ - position);
+  std::memcpy(&(*data)[old_size], buffer_.get() + position, first);
+  std::memcpy(&(*data)[old_size + first], buffer_.get(), size - first);
+
+  // Discard the part that the writer may have overwritten while it was
+  // being copied.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  std::uint64_t reserved = reserved_.load(std::memory_order_relaxed);
+  if (reserved > capacity_ && reserved - capacity_ > offset) {
+    std::size_t overwritten =
+        std::min<std::uint64_t>(reserved - capacity_ - offset, size);
+    data->erase(old_size, overwritten);
+    offset += overwritten;
+  }
+  return offset;
+}
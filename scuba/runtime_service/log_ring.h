@@ -0,0 +1,83 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_LOG_RING_H
+#define SCUBA_RUNTIME_SERVICE_LOG_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace scuba {
+namespace runtime_service {
+
+// Bounded buffer of the most recent output of a container, which can be
+// read by any number of attached clients. Data is addressed by its
+// offset in the output stream as a whole.
+//
+// There is a single writer, which never waits for readers: old data is
+// overwritten, and readers that fall behind skip ahead. Readers copy
+// data without locking and discard whatever got overwritten while doing
+// so, similar to a seqlock.
+//
+// The buffer is allocated upon the first write, so that containers that
+// are never started or produce no output don't use any memory for it.
+class LogRing {
+ public:
+  // The capacity must be a power of two.
+  explicit LogRing(std::size_t capacity);
+
+  void Write(std::string_view data);
+  // Marks the end of the output, waking up all readers.
+  void Close();
+
+  // Offset just past the most recently written data.
+  std::uint64_t GetEnd() const {
+    return end_.load(std::memory_order_acquire);
+  }
+
+  // Appends data starting at the offset, waiting for at most the timeout
+  // if no such data has been written yet. Returns the offset of the
+  // first byte appended, which lies past the one provided if data has
+  // been overwritten before it could be read.
+  std::uint64_t Read(std::uint64_t offset, std::chrono::milliseconds timeout,
+                     std::string* data);
+  // Returns true if the output has ended and no data past the offset
+  // remains.
+  bool IsFinished(std::uint64_t offset) const {
+    return closed_.load(std::memory_order_acquire) && offset >= GetEnd();
+  }
+
+ private:
+  const std::size_t capacity_;
+  // Only assigned by the writer before data is written. Readers only
+  // access it once they observe data, which orders it.
+  std::unique_ptr<char[]> buffer_;
+
+  // Offset past the data that is being written and the data that has
+  // been written. Data in between may be in an inconsistent state.
+  std::atomic<std::uint64_t> reserved_;
+  std::atomic<std::uint64_t> end_;
+  std::atomic<bool> closed_;
+
+  // Readers that have caught up block on a condition variable. The
+  // writer only acquires the lock if there are such readers.
+  std::atomic<std::size_t> waiting_readers_;
+  std::mutex lock_;
+  std::condition_variable written_;
+
+  LogRing(LogRing&) = delete;
+  void operator=(LogRing) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -4,8 +4,8 @@
 
 #include "scuba/runtime_service/naming_scheme.h"
 
-#include <algorithm>
-#include <sstream>
+#include <charconv>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -16,34 +16,53 @@ using runtime::ContainerMetadata;
 using runtime::PodSandboxMetadata;
 using scuba::runtime_service::NamingScheme;
 
+namespace {
+
+// Names are composed by appending to a string whose capacity has been
+// reserved up front, so that every name requires a single allocation.
+void AppendNumber(std::string* name, std::uint32_t number) {
+  char buf[10];
+  char* end = std::to_chars(buf, buf + sizeof(buf), number).ptr;
+  name->append(buf, end - buf);
+}
+
+}  // namespace
+
 std::string NamingScheme::CreatePodSandboxName(
     const PodSandboxMetadata& metadata) {
-  std::ostringstream ss;
-  ss << "name=" << metadata.name() << ",uid=" << metadata.uid()
-     << ",namespace=" << metadata.namespace_()
-     << ",attempt=" << metadata.attempt();
-  return ss.str();
+  std::string name;
+  name.reserve(40 + metadata.name().size() + metadata.uid().size() +
+               metadata.namespace_().size());
+  name.append("name=").append(metadata.name());
+  name.append(",uid=").append(metadata.uid());
+  name.append(",namespace=").append(metadata.namespace_());
+  name.append(",attempt=");
+  AppendNumber(&name, metadata.attempt());
+  return name;
 }
 
 std::string NamingScheme::CreateContainerName(
     const ContainerMetadata& metadata) {
-  std::ostringstream ss;
-  ss << "name=" << metadata.name() << ",attempt=" << metadata.attempt();
-  return ss.str();
+  std::string name;
+  name.reserve(24 + metadata.name().size());
+  name.append("name=").append(metadata.name());
+  name.append(",attempt=");
+  AppendNumber(&name, metadata.attempt());
+  return name;
 }
 
 std::string NamingScheme::ComposePodSandboxContainerName(
     std::string_view pod_sandbox_id, std::string_view container_id) {
-  std::ostringstream ss;
-  ss << pod_sandbox_id << "|" << container_id;
-  return ss.str();
+  std::string name;
+  name.reserve(pod_sandbox_id.size() + 1 + container_id.size());
+  name.append(pod_sandbox_id).append(1, '|').append(container_id);
+  return name;
 }
 
 std::pair<std::string_view, std::string_view>
 NamingScheme::DecomposePodSandboxContainerName(std::string_view id) {
-  auto split = std::find(id.begin(), id.end(), '|');
-  if (split == id.end())
+  std::size_t split = id.find('|');
+  if (split == std::string_view::npos)
     return {};
-  return {std::string_view(id.begin(), split - id.begin()),
-          std::string_view(split + 1, id.end() - (split + 1))};
+  return {id.substr(0, split), id.substr(split + 1)};
 }
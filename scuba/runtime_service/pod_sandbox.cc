@@ -4,8 +4,6 @@
 
 #include "scuba/runtime_service/pod_sandbox.h"
 
-#include <fcntl.h>
-#include <cerrno>
 #include <chrono>
 #include <cstdint>
 #include <memory>
@@ -22,7 +20,16 @@
 #include "arpc++/arpc++.h"
 #include "flower/protocol/switchboard.ad.h"
 #include "google/protobuf/map.h"
+#include "scuba/runtime_service/cgroup.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/events.pb.h"
 #include "scuba/runtime_service/ip_address_allocator.h"
+#include "scuba/runtime_service/journal.pb.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/naming_scheme.h"
+#include "scuba/runtime_service/state_journal.h"
+#include "scuba/util/reclaimer.h"
+#include "scuba/util/trace.h"
 
 using arpc::FileDescriptor;
 using flower::protocol::switchboard::Switchboard;
@@ -33,26 +40,53 @@ using runtime::ContainerStatus;
 using runtime::PodSandboxConfig;
 using runtime::PodSandboxState;
 using runtime::PodSandboxStatus;
+using scuba::events::EventType;
+using scuba::journal::Record;
+using scuba::runtime_service::Cgroup;
+using scuba::runtime_service::Container;
+using scuba::runtime_service::CpuSetAllocator;
+using scuba::runtime_service::FromJournalTime;
 using scuba::runtime_service::IPAddressLease;
+using scuba::runtime_service::LogRing;
+using scuba::runtime_service::NamingScheme;
 using scuba::runtime_service::PodSandbox;
+using scuba::runtime_service::StartScheduler;
+using scuba::runtime_service::ToJournalTime;
+using scuba::util::Reclaimer;
+using scuba::util::TraceSpan;
 
-PodSandbox::PodSandbox(const PodSandboxConfig& config,
-                       IPAddressLease ip_address_lease)
+PodSandbox::PodSandbox(std::string_view id, const PodSandboxConfig& config,
+                       std::chrono::system_clock::time_point creation_time,
+                       IPAddressLease ip_address_lease, EventLog* event_log,
+                       StateJournal* state_journal,
+                       const Cgroup* parent_cgroup,
+                       CpuSetAllocator* cpu_set_allocator,
+                       StartScheduler* start_scheduler)
     : metadata_(config.metadata()),
       log_directory_(config.log_directory()),
-      creation_time_(std::chrono::system_clock::now()),
+      creation_time_(creation_time),
       labels_(config.labels()),
       annotations_(config.annotations()),
       ip_address_lease_(std::move(ip_address_lease)),
+      id_(id),
+      event_log_(event_log),
+      state_journal_(state_journal),
+      cpu_set_allocator_(cpu_set_allocator),
+      start_scheduler_(start_scheduler),
+      lock_("PodSandbox::lock_"),
       state_(PodSandboxState::SANDBOX_READY) {
+  if (parent_cgroup != nullptr) {
+    cgroup_ = std::make_unique<Cgroup>(parent_cgroup, id_);
+    cgroup_->EnableControllers(cpu_set_allocator_ != nullptr);
+  }
 }
 
 void PodSandbox::GetInfo(runtime::PodSandbox* info) {
   *info->mutable_metadata() = metadata_;
   info->set_created_at(
       std::chrono::nanoseconds(creation_time_.time_since_epoch()).count());
-  *info->mutable_labels() = labels_;
-  *info->mutable_annotations() = annotations_;
+  labels_.CopyTo(info->mutable_labels());
+  annotations_.CopyTo(info->mutable_annotations());
 
   std::shared_lock lock(lock_);
   info->set_state(state_);
@@ -62,40 +96,49 @@ void PodSandbox::GetStatus(PodSandboxStatus* status) {
   *status->mutable_metadata() = metadata_;
   status->set_created_at(creation_time_.time_since_epoch().count());
   status->mutable_network()->set_ip(ip_address_lease_.GetString());
-  *status->mutable_labels() = labels_;
-  *status->mutable_annotations() = annotations_;
+  labels_.CopyTo(status->mutable_labels());
+  annotations_.CopyTo(status->mutable_annotations());
 
   std::shared_lock lock(lock_);
   status->set_state(state_);
 }
 
-void PodSandbox::Stop() {
-  // Do a forced stop of all containers in the pod sandbox. Switch the
-  // state to SANDBOX_NOTREADY. Otherwise, Kubernetes will not attempt
+bool PodSandbox::Stop() {
+  // Switch the state to SANDBOX_NOTREADY, so that no new containers
+  // can be created or started. Otherwise, Kubernetes will not attempt
   // to destroy it.
-  std::unique_lock lock(lock_);
+  bool was_ready;
+  {
+    std::unique_lock lock(lock_);
+    was_ready = state_ == PodSandboxState::SANDBOX_READY;
+    state_ = PodSandboxState::SANDBOX_NOTREADY;
+  }
+
+  // Do a forced stop of all containers in the pod sandbox. Signal all
+  // of them before waiting, so that they terminate in parallel.
+  std::shared_lock lock(lock_);
+  for (const auto& container : containers_)
+    container.second->RequestStop(0);
   for (const auto& container : containers_)
-    container.second->Stop(0);
-  state_ = PodSandboxState::SANDBOX_NOTREADY;
+    container.second->WaitUntilStopped();
+  return was_ready;
 }
 
 bool PodSandbox::MatchesFilter(std::optional<PodSandboxState> state,
                                const Map<std::string, std::string>& labels) {
-  // Perform subset match on labels. We can't use std::includes() here,
-  // as these maps use hashing.
-  for (const auto& label : labels) {
-    const auto& match = labels_.find(label.first);
-    if (match == labels_.end() || label.second != match->second)
-      return false;
-  }
+  // Perform subset match on labels.
+  if (!labels_.Includes(labels))
+    return false;
   if (!state)
     return true;
   std::shared_lock lock(lock_);
   return *state == state_;
 }
 
-void PodSandbox::CreateContainer(std::string_view container_id,
-                                 const ContainerConfig& config) {
+void PodSandbox::CreateContainer(
+    std::string_view container_id, const ContainerConfig& config,
+    const FileDescriptor& root_directory, const FileDescriptor& image_directory,
+    Switchboard::Stub* containers_switchboard_handle) {
   std::unique_lock lock(lock_);
   if (state_ != PodSandboxState::SANDBOX_READY)
     throw std::logic_error(std::string(container_id) +
@@ -103,21 +146,58 @@ void PodSandbox::CreateContainer(std::string_view container_id,
 
   // Idempotence: only create the container if it doesn't exist yet.
   auto container = containers_.find(container_id);
-  if (container == containers_.end())
-    containers_.insert(
-        container,
-        std::make_pair(container_id, std::make_unique<Container>(config)));
+  if (container == containers_.end()) {
+    auto creation_time = std::chrono::system_clock::now();
+    auto new_container = std::make_shared<Container>(
+        id_, container_id, config, creation_time, event_log_, state_journal_);
+    container =
+        containers_.emplace(new_container->GetId(), std::move(new_container))
+            .first;
+    container->second->Prepare(metadata_, log_directory_, root_directory,
+                               image_directory, containers_switchboard_handle,
+                               cgroup_.get(), cpu_set_allocator_,
+                               start_scheduler_);
+    event_log_->Publish(
+        EventType::CONTAINER_CREATED, id_,
+        NamingScheme::ComposePodSandboxContainerName(id_, container_id));
+    if (state_journal_ != nullptr) {
+      Record record;
+      auto created = record.mutable_container_created();
+      created->set_pod_sandbox_id(id_);
+      created->set_container_id(std::string(container_id));
+      *created->mutable_config() = config;
+      created->set_created_at(ToJournalTime(creation_time));
+      state_journal_->Append(record);
+    }
+  }
 }
 
 void PodSandbox::RemoveContainer(std::string_view container_id) {
   std::unique_lock lock(lock_);
-  containers_.erase(containers_.find(container_id));
+  auto container = containers_.find(container_id);
+  if (container != containers_.end()) {
+    // Destroy the container in the background after unlinking it, as
+    // that requires access to the event loop of child processes.
+    std::shared_ptr<Container> removed = std::move(container->second);
+    containers_.erase(container);
+    Reclaimer::Default()->Retire(std::move(removed));
+    event_log_->Publish(
+        EventType::CONTAINER_REMOVED, id_,
+        NamingScheme::ComposePodSandboxContainerName(id_, container_id));
+    if (state_journal_ != nullptr) {
+      Record record;
+      auto container_removed = record.mutable_container_removed();
+      container_removed->set_pod_sandbox_id(id_);
+      container_removed->set_container_id(std::string(container_id));
+      state_journal_->Append(record);
+    }
+  }
 }
 
-void PodSandbox::StartContainer(
-    std::string_view container_id, const FileDescriptor& root_directory,
-    const FileDescriptor& image_directory,
-    Switchboard::Stub* containers_switchboard_handle) {
+void PodSandbox::StartContainer(std::string_view container_id) {
+  TraceSpan span("PodSandbox::StartContainer", [this, container_id]() {
+    return NamingScheme::ComposePodSandboxContainerName(id_, container_id);
+  });
   std::shared_lock lock(lock_);
   if (state_ != PodSandboxState::SANDBOX_READY)
     throw std::logic_error(std::string(container_id) +
@@ -126,28 +206,33 @@ void PodSandbox::StartContainer(
   auto container = containers_.find(container_id);
   if (container == containers_.end())
     throw std::invalid_argument(std::string(container_id) + " does not exist");
-
-  // Turn provided log directory into a path relative to the root.
-  const char* log_directory = log_directory_.c_str();
-  while (*log_directory == '/')
-    ++log_directory;
-  int fd = openat(root_directory.get(), log_directory, O_DIRECTORY | O_SEARCH);
-  if (fd < 0)
-    throw std::system_error(errno, std::system_category(), log_directory_);
-  container->second->Start(metadata_, root_directory, image_directory,
-                           FileDescriptor(fd), containers_switchboard_handle);
+  container->second->Start();
 }
 
 bool PodSandbox::StopContainer(std::string_view container_id,
                                std::int64_t timeout) {
-  std::shared_lock lock(lock_);
-  auto container = containers_.find(container_id);
-  if (container == containers_.end())
-    return false;
-  container->second->Stop(timeout);
+  // Wait for the container to terminate without holding on to the
+  // lock, so that other containers in the pod sandbox can still be
+  // created, inspected and stopped in the meantime.
+  std::shared_ptr<Container> container;
+  {
+    std::shared_lock lock(lock_);
+    auto lookup = containers_.find(container_id);
+    if (lookup == containers_.end())
+      return false;
+    container = lookup->second;
+    container->RequestStop(timeout);
+  }
+  container->WaitUntilStopped();
   return true;
 }
 
+void PodSandbox::SetSharedCpus(std::string_view cpus) {
+  std::shared_lock lock(lock_);
+  for (const auto& container : containers_)
+    container.second->SetSharedCpus(cpus);
+}
+
 std::vector<std::pair<std::string, runtime::Container>>
 PodSandbox::GetContainerInfo(std::string_view container_id,
                              std::optional<ContainerState> state,
@@ -176,3 +261,105 @@ bool PodSandbox::GetContainerStatus(std::string_view container_id,
   container->second->GetStatus(status);
   return true;
 }
+
+std::shared_ptr<LogRing> PodSandbox::GetContainerOutput(
+    std::string_view container_id) {
+  std::shared_lock lock(lock_);
+  auto container = containers_.find(container_id);
+  if (container == containers_.end())
+    return nullptr;
+  return container->second->GetOutput();
+}
+
+std::vector<std::pair<std::string, runtime::ContainerStats>>
+PodSandbox::GetContainerStats(std::string_view container_id,
+                              const Map<std::string, std::string>& labels) {
+  std::vector<std::pair<std::string, runtime::ContainerStats>> stats;
+  std::shared_lock lock(lock_);
+  for (const auto& container : containers_) {
+    // Apply filters.
+    if (!container_id.empty() && container_id != container.first)
+      continue;
+    if (!container.second->MatchesFilter(std::nullopt, labels))
+      continue;
+
+    stats.emplace_back(container.first, runtime::ContainerStats{});
+    container.second->GetStats(&stats.back().second);
+  }
+  return stats;
+}
+
+void PodSandbox::RestoreContainer(const Record& record) {
+  std::unique_lock lock(lock_);
+  switch (record.record_case()) {
+    case Record::kContainerCreated: {
+      const auto& created = record.container_created();
+      if (containers_.count(created.container_id()) == 0) {
+        auto container = std::make_shared<Container>(
+            id_, created.container_id(), created.config(),
+            FromJournalTime(created.created_at()), event_log_, state_journal_);
+        containers_.emplace(container->GetId(), std::move(container));
+      }
+      break;
+    }
+    case Record::kContainerStarted: {
+      const auto& started = record.container_started();
+      auto container = containers_.find(started.container_id());
+      if (container != containers_.end())
+        container->second->RestoreStarted(
+            FromJournalTime(started.started_at()));
+      break;
+    }
+    case Record::kContainerExited: {
+      const auto& exited = record.container_exited();
+      auto container = containers_.find(exited.container_id());
+      if (container != containers_.end())
+        container->second->RestoreExited(FromJournalTime(exited.finished_at()),
+                                         exited.exit_code());
+      break;
+    }
+    case Record::kContainerRemoved: {
+      auto container =
+          containers_.find(record.container_removed().container_id());
+      if (container != containers_.end()) {
+        std::shared_ptr<Container> removed = std::move(container->second);
+        containers_.erase(container);
+      }
+      break;
+    }
+    default:
+      throw std::invalid_argument("Record does not apply to containers");
+  }
+}
+
+void PodSandbox::PrepareContainers(
+    const FileDescriptor& root_directory, const FileDescriptor& image_directory,
+    Switchboard::Stub* containers_switchboard_handle) {
+  std::shared_lock lock(lock_);
+  if (state_ != PodSandboxState::SANDBOX_READY)
+    return;
+  for (const auto& container : containers_)
+    container.second->Prepare(metadata_, log_directory_, root_directory,
+                              image_directory, containers_switchboard_handle,
+                              cgroup_.get(), cpu_set_allocator_,
+                              start_scheduler_);
+}
+
+void PodSandbox::Snapshot(std::vector<Record>* records) {
+  auto created = records->emplace_back().mutable_pod_sandbox_created();
+  created->set_pod_sandbox_id(id_);
+  PodSandboxConfig* config = created->mutable_config();
+  *config->mutable_metadata() = metadata_;
+  config->set_log_directory(log_directory_);
+  labels_.CopyTo(config->mutable_labels());
+  annotations_.CopyTo(config->mutable_annotations());
+  created->set_created_at(ToJournalTime(creation_time_));
+  created->set_ip_address(ip_address_lease_.GetAddress());
+
+  std::shared_lock lock(lock_);
+  for (const auto& container : containers_)
+    container.second->Snapshot(records);
+  if (state_ != PodSandboxState::SANDBOX_READY)
+    records->emplace_back().mutable_pod_sandbox_stopped()->set_pod_sandbox_id(
+        id_);
+}
@@ -7,12 +7,12 @@
 
 #include <chrono>
 #include <cstdint>
-#include <map>
 #include <memory>
 #include <optional>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -20,53 +20,102 @@
 #include "flower/protocol/switchboard.ad.h"
 #include "google/protobuf/map.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/cgroup.h"
 #include "scuba/runtime_service/container.h"
+#include "scuba/runtime_service/cpu_set_allocator.h"
+#include "scuba/runtime_service/interned_config.h"
 #include "scuba/runtime_service/ip_address_allocator.h"
+#include "scuba/runtime_service/journal.pb.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/start_scheduler.h"
+#include "scuba/util/lock_profiler.h"
 
 namespace scuba {
 namespace runtime_service {
 
+class EventLog;
+class StateJournal;
+
 class PodSandbox {
  public:
-  explicit PodSandbox(const runtime::PodSandboxConfig& config,
-                      IPAddressLease ip);
+  // If a control group is provided, the pod sandbox creates a nested
+  // one in which the control groups of its containers are placed.
+  PodSandbox(std::string_view id, const runtime::PodSandboxConfig& config,
+             std::chrono::system_clock::time_point creation_time,
+             IPAddressLease ip, EventLog* event_log,
+             StateJournal* state_journal, const Cgroup* parent_cgroup,
+             CpuSetAllocator* cpu_set_allocator,
+             StartScheduler* start_scheduler);
 
+  std::string_view GetId() const {
+    return id_;
+  }
+  const runtime::PodSandboxMetadata& GetMetadata() const {
+    return metadata_;
+  }
   void GetInfo(runtime::PodSandbox* info);
   void GetStatus(runtime::PodSandboxStatus* status);
-  void Stop();
+  // Stops all containers. Returns false if already stopped.
+  bool Stop();
 
   bool MatchesFilter(
       std::optional<runtime::PodSandboxState> state,
       const google::protobuf::Map<std::string, std::string>& labels);
 
   void CreateContainer(std::string_view container_id,
-                       const runtime::ContainerConfig& config);
+                       const runtime::ContainerConfig& config,
+                       const arpc::FileDescriptor& root_directory,
+                       const arpc::FileDescriptor& image_directory,
+                       flower::protocol::switchboard::Switchboard::Stub*
+                           containers_switchboard_handle);
   void RemoveContainer(std::string_view container_id);
-  void StartContainer(std::string_view container_id,
-                      const arpc::FileDescriptor& root_directory,
-                      const arpc::FileDescriptor& image_directory,
-                      flower::protocol::switchboard::Switchboard::Stub*
-                          containers_switchboard_handle);
+  void StartContainer(std::string_view container_id);
   bool StopContainer(std::string_view container_id, std::int64_t timeout);
+  void SetSharedCpus(std::string_view cpus);
   std::vector<std::pair<std::string, runtime::Container>> GetContainerInfo(
       std::string_view container_id,
       std::optional<runtime::ContainerState> state,
       const google::protobuf::Map<std::string, std::string>& labels);
   bool GetContainerStatus(std::string_view container_id,
                           runtime::ContainerStatus* status);
+  std::shared_ptr<LogRing> GetContainerOutput(std::string_view container_id);
+  std::vector<std::pair<std::string, runtime::ContainerStats>>
+  GetContainerStats(
+      std::string_view container_id,
+      const google::protobuf::Map<std::string, std::string>& labels);
+
+  // Functions for restoring state from the journal. Containers that
+  // have not been started are only prepared after all records have
+  // been applied, as they may turn out to be removed.
+  void RestoreContainer(const journal::Record& record);
+  void PrepareContainers(const arpc::FileDescriptor& root_directory,
+                         const arpc::FileDescriptor& image_directory,
+                         flower::protocol::switchboard::Switchboard::Stub*
+                             containers_switchboard_handle);
+  void Snapshot(std::vector<journal::Record>* records);
 
  private:
   // Data that should be returned through PodSandboxStatus.
   const runtime::PodSandboxMetadata metadata_;
   const std::string log_directory_;
   const std::chrono::system_clock::time_point creation_time_;
-  const google::protobuf::Map<std::string, std::string> labels_;
-  const google::protobuf::Map<std::string, std::string> annotations_;
+  const InternedMap labels_;
+  const InternedMap annotations_;
   const IPAddressLease ip_address_lease_;
 
-  std::shared_mutex lock_;
+  const std::string id_;
+  EventLog* const event_log_;
+  StateJournal* const state_journal_;
+  // Declared before the containers, as it must outlive theirs.
+  std::unique_ptr<Cgroup> cgroup_;
+  CpuSetAllocator* const cpu_set_allocator_;
+  StartScheduler* const start_scheduler_;
+
+  util::ProfiledSharedMutex lock_;
   runtime::PodSandboxState state_;
-  std::map<std::string, std::unique_ptr<Container>, std::less<>> containers_;
+  // Containers, keyed by the identifier stored in the container itself.
+  std::unordered_map<std::string_view, std::shared_ptr<Container>>
+      containers_;
 
   PodSandbox(PodSandbox&) = delete;
   void operator=(PodSandbox) = delete;
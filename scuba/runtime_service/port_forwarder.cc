@@ -0,0 +1,126 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/port_forwarder.h"
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/server.ad.h"
+#include "flower/protocol/switchboard.ad.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/runtime_service/pod_sandbox.h"
+#include "scuba/runtime_service/runtime_service.h"
+#include "scuba/util/metrics.h"
+#include "scuba/util/stream_relay.h"
+
+using arpc::ClientContext;
+using arpc::FileDescriptor;
+using arpc::ServerContext;
+using arpc::Status;
+using flower::protocol::server::ConnectRequest;
+using flower::protocol::server::ConnectResponse;
+using flower::protocol::switchboard::ClientConnectRequest;
+using flower::protocol::switchboard::ClientConnectResponse;
+using flower::protocol::switchboard::ConstrainRequest;
+using flower::protocol::switchboard::ConstrainResponse;
+using flower::protocol::switchboard::Right;
+using flower::protocol::switchboard::Switchboard;
+using runtime::PodSandboxMetadata;
+using scuba::runtime_service::PodSandbox;
+using scuba::runtime_service::PortForwarder;
+using scuba::util::Counter;
+using scuba::util::MetricsRegistry;
+using scuba::util::RelayStreams;
+
+namespace {
+
+Counter* const forwarded_connections = MetricsRegistry::Default()->GetCounter(
+    "scuba_port_forward_connections_total",
+    "Number of connections forwarded to pod sandboxes.");
+Counter* const failed_connections = MetricsRegistry::Default()->GetCounter(
+    "scuba_port_forward_failures_total",
+    "Number of connections that could not be forwarded to pod sandboxes.");
+
+}  // namespace
+
+Status PortForwarder::Connect(ServerContext* context,
+                              const ConnectRequest* request,
+                              ConnectResponse* response) {
+  std::shared_ptr<FileDescriptor> client = request->client();
+  if (!client)
+    return Status::OK;
+
+  // Connect to the server and relay data in the background, so that
+  // other incoming connections are not held up.
+  std::thread([this, client{std::move(client)},
+               labels{std::map<std::string, std::string>(
+                   request->client_labels().begin(),
+                   request->client_labels().end())}]() {
+    auto fail = [&labels](const std::string& message) {
+      failed_connections->Increment();
+      std::cerr << "Failed to forward connection";
+      for (const auto& label : labels)
+        std::cerr << " " << label.first << "=" << label.second;
+      std::cerr << ": " << message << std::endl;
+    };
+
+    auto pod_sandbox_id = labels.find("pod_sandbox_id");
+    if (pod_sandbox_id == labels.end())
+      return fail("No pod_sandbox_id label provided");
+    // Only retain the metadata of the pod sandbox. Connections may be
+    // relayed long after it has been removed, and holding on to it
+    // would delay releasing its IP address and control group.
+    PodSandboxMetadata metadata;
+    {
+      std::shared_ptr<PodSandbox> pod_sandbox =
+          runtime_service_->GetPodSandbox(pod_sandbox_id->second);
+      if (!pod_sandbox)
+        return fail("Pod sandbox does not exist");
+      metadata = pod_sandbox->GetMetadata();
+    }
+
+    // Only allow connecting to servers started by the pod sandbox's
+    // containers. These are labeled by the runtime service.
+    ConstrainRequest constrain_request;
+    constrain_request.add_rights(Right::CLIENT_CONNECT);
+    auto out_labels = constrain_request.mutable_out_labels();
+    (*out_labels)["server_kubernetes_namespace"] = metadata.namespace_();
+    (*out_labels)["server_kubernetes_pod_name"] = metadata.name();
+    (*out_labels)["server_kubernetes_pod_attempt"] =
+        std::to_string(metadata.attempt());
+    for (const auto& label : labels)
+      if (label.first != "pod_sandbox_id")
+        out_labels->emplace(label.first, label.second);
+    ClientContext constrain_context;
+    ConstrainResponse constrain_response;
+    if (Status status = containers_switchboard_handle_->Constrain(
+            &constrain_context, constrain_request, &constrain_response);
+        !status.ok())
+      return fail(status.error_message());
+    if (!constrain_response.switchboard())
+      return fail("Switchboard did not return a file descriptor");
+
+    std::unique_ptr<Switchboard::Stub> switchboard = Switchboard::NewStub(
+        arpc::CreateChannel(constrain_response.switchboard()));
+    ClientContext connect_context;
+    ClientConnectRequest connect_request;
+    ClientConnectResponse connect_response;
+    if (Status status = switchboard->ClientConnect(
+            &connect_context, connect_request, &connect_response);
+        !status.ok())
+      return fail(status.error_message());
+    if (!connect_response.server())
+      return fail("Switchboard did not return a file descriptor");
+
+    forwarded_connections->Increment();
+    RelayStreams(client->get(), connect_response.server()->get());
+  })
+      .detach();
+  return Status::OK;
+}
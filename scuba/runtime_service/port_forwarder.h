@@ -0,0 +1,46 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_PORT_FORWARDER_H
+#define SCUBA_RUNTIME_SERVICE_PORT_FORWARDER_H
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/server.ad.h"
+#include "flower/protocol/switchboard.ad.h"
+
+namespace scuba {
+namespace runtime_service {
+
+class RuntimeService;
+
+// Forwards incoming connections from Flower to servers started by the
+// containers of a pod sandbox. Clients select the pod sandbox through
+// the pod_sandbox_id label. All other labels of the client are used to
+// select one of the pod sandbox's servers (e.g., a port label).
+class PortForwarder : public flower::protocol::server::Server::Service {
+ public:
+  PortForwarder(RuntimeService* runtime_service,
+                flower::protocol::switchboard::Switchboard::Stub*
+                    containers_switchboard_handle)
+      : runtime_service_(runtime_service),
+        containers_switchboard_handle_(containers_switchboard_handle) {
+  }
+
+  arpc::Status Connect(arpc::ServerContext* context,
+                       const flower::protocol::server::ConnectRequest* request,
+                       flower::protocol::server::ConnectResponse* response);
+
+ private:
+  RuntimeService* const runtime_service_;
+  flower::protocol::switchboard::Switchboard::Stub* const
+      containers_switchboard_handle_;
+
+  PortForwarder(PortForwarder&) = delete;
+  void operator=(PortForwarder) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -4,16 +4,35 @@
 
 #include <program.h>
 #include <stdio.h>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
+#include <iostream>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "arpc++/arpc++.h"
 #include "flower/protocol/switchboard.ad.h"
 #include "grpc++/grpc++.h"
+#include "scuba/runtime_service/attach_service.h"
+#include "scuba/runtime_service/cgroup.h"
 #include "scuba/runtime_service/configuration.ad.h"
+#include "scuba/runtime_service/cpu_set_allocator.h"
+#include "scuba/runtime_service/debug_service.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/event_service.h"
 #include "scuba/runtime_service/ip_address_allocator.h"
+#include "scuba/runtime_service/port_forwarder.h"
 #include "scuba/runtime_service/runtime_service.h"
+#include "scuba/runtime_service/start_scheduler.h"
+#include "scuba/runtime_service/state_journal.h"
 #include "scuba/util/grpc_connection_injector.h"
+#include "scuba/util/grpc_metrics_interceptor.h"
+#include "scuba/util/grpc_request_recorder.h"
+#include "scuba/util/lock_profiler.h"
+#include "scuba/util/metrics.h"
+#include "scuba/util/trace.h"
 
 using arpc::ArgdataParser;
 using arpc::ClientContext;
@@ -22,10 +41,24 @@ using arpc::Status;
 using flower::protocol::switchboard::ServerStartRequest;
 using flower::protocol::switchboard::ServerStartResponse;
 using flower::protocol::switchboard::Switchboard;
+using scuba::runtime_service::AttachService;
+using scuba::runtime_service::Cgroup;
 using scuba::runtime_service::Configuration;
+using scuba::runtime_service::CpuSetAllocator;
+using scuba::runtime_service::DebugService;
+using scuba::runtime_service::EventLog;
+using scuba::runtime_service::EventService;
 using scuba::runtime_service::IPAddressAllocator;
+using scuba::runtime_service::PortForwarder;
 using scuba::runtime_service::RuntimeService;
+using scuba::runtime_service::StartScheduler;
+using scuba::runtime_service::StateJournal;
 using scuba::util::GrpcConnectionInjector;
+using scuba::util::GrpcMetricsInterceptorFactory;
+using scuba::util::GrpcRequestRecorderFactory;
+using scuba::util::LockProfiler;
+using scuba::util::MetricsRegistry;
+using scuba::util::Tracer;
 
 void program_main(const argdata_t* ad) {
   Configuration configuration;
@@ -66,13 +99,122 @@ void program_main(const argdata_t* ad) {
   std::unique_ptr<Switchboard::Stub> containers_switchboard_handle =
       Switchboard::NewStub(CreateChannel(containers_switchboard_handle_fd));
 
+  // Periodically export metrics for Prometheus' textfile collector.
+  if (std::shared_ptr<FileDescriptor> metrics_directory =
+          configuration.metrics_directory();
+      metrics_directory) {
+    std::thread([metrics_directory]() {
+      for (;;) {
+        try {
+          MetricsRegistry::Default()->WriteTextFile(
+              *metrics_directory, "scuba_runtime_service.prom");
+        } catch (const std::exception& e) {
+          std::cerr << "Failed to export metrics: " << e.what() << std::endl;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(15));
+      }
+    }).detach();
+  }
+
+  // Open the journal for persisting state across restarts, if any.
+  std::unique_ptr<StateJournal> state_journal;
+  if (const std::shared_ptr<FileDescriptor>& state_directory =
+          configuration.state_directory();
+      state_directory)
+    state_journal = std::make_unique<StateJournal>(state_directory.get());
+
+  // Apply resource limits through a delegated cgroup v2 hierarchy, if
+  // any. Pod sandboxes and containers get their own nested ones.
+  std::unique_ptr<Cgroup> cgroup;
+  if (const std::shared_ptr<FileDescriptor>& cgroup_directory =
+          configuration.cgroup_directory();
+      cgroup_directory) {
+    cgroup = std::make_unique<Cgroup>(cgroup_directory);
+    try {
+      cgroup->EnableControllers(!configuration.exclusive_cpus().empty());
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to enable cgroup controllers: " << e.what()
+                << std::endl;
+      std::exit(1);
+    }
+  }
+
+  // Assign CPUs exclusively to containers that request them. The CPUs
+  // used by the runtime service itself should be left out, by starting
+  // it on CPUs that are not listed.
+  std::unique_ptr<CpuSetAllocator> cpu_set_allocator;
+  if (!configuration.exclusive_cpus().empty()) {
+    if (!cgroup) {
+      std::cerr << "Exclusive CPUs require a cgroup directory" << std::endl;
+      std::exit(1);
+    }
+    try {
+      cpu_set_allocator = std::make_unique<CpuSetAllocator>(
+          configuration.exclusive_cpus(), cgroup->GetEffectiveCpus());
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      std::exit(1);
+    }
+  }
+
   // Start the CRI service using GRPC.
   IPAddressAllocator ip_address_allocator;
-  RuntimeService runtime_service(root_directory.get(), image_directory.get(),
-                                 containers_switchboard_handle.get(),
-                                 &ip_address_allocator);
+  EventLog event_log(4096);
+  StartScheduler start_scheduler(
+      configuration.max_concurrent_container_starts() > 0
+          ? configuration.max_concurrent_container_starts()
+          : 16);
+  RuntimeService runtime_service(
+      root_directory.get(), image_directory.get(),
+      containers_switchboard_handle.get(), &ip_address_allocator, &event_log,
+      state_journal.get(), cgroup.get(), cpu_set_allocator.get(),
+      &start_scheduler);
+  if (state_journal) {
+    try {
+      runtime_service.RestoreState();
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to restore state: " << e.what() << std::endl;
+      std::exit(1);
+    }
+    std::thread([&state_journal, &runtime_service]() {
+      LockProfiler::SetOperation("RuntimeService::CompactJournal");
+      for (;;) {
+        std::this_thread::sleep_for(std::chrono::minutes(1));
+        if (state_journal->NeedsCompaction())
+          runtime_service.CompactJournal();
+      }
+    }).detach();
+  }
+  if (cpu_set_allocator) {
+    // Processes that terminate by themselves return their exclusive
+    // CPUs without going through the runtime service.
+    std::thread([&cpu_set_allocator, &runtime_service]() {
+      LockProfiler::SetOperation("RuntimeService::UpdateSharedCpus");
+      for (;;) {
+        cpu_set_allocator->WaitForDeallocation();
+        runtime_service.UpdateSharedCpus();
+      }
+    }).detach();
+  }
+  EventService event_service(&event_log);
+  DebugService debug_service(Tracer::Default(), LockProfiler::Default());
+  AttachService attach_service(&runtime_service);
   grpc::ServerBuilder cri_builder;
   cri_builder.RegisterService(&runtime_service);
+  cri_builder.RegisterService(&event_service);
+  cri_builder.RegisterService(&debug_service);
+  cri_builder.RegisterService(&attach_service);
+  std::vector<
+      std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>>
+      interceptors;
+  interceptors.push_back(std::make_unique<GrpcMetricsInterceptorFactory>(
+      MetricsRegistry::Default()));
+  if (const std::shared_ptr<FileDescriptor>& request_log =
+          configuration.request_log();
+      request_log)
+    interceptors.push_back(
+        std::make_unique<GrpcRequestRecorderFactory>(request_log));
+  cri_builder.experimental().SetInterceptorCreators(std::move(interceptors));
   std::unique_ptr<grpc::Server> cri_server(cri_builder.BuildAndStart());
   if (!cri_server)
     std::exit(1);
@@ -88,6 +230,33 @@ void program_main(const argdata_t* ad) {
   if (!response.server())
     std::exit(1);
 
+  // Forward incoming connections to the servers of pod sandboxes.
+  PortForwarder port_forwarder(&runtime_service,
+                               containers_switchboard_handle.get());
+  if (const std::shared_ptr<FileDescriptor>& port_forward_handle_fd =
+          configuration.port_forward_switchboard_handle();
+      port_forward_handle_fd) {
+    std::unique_ptr<Switchboard::Stub> port_forward_handle =
+        Switchboard::NewStub(CreateChannel(port_forward_handle_fd));
+    ClientContext context;
+    ServerStartRequest request;
+    ServerStartResponse response;
+    if (Status status =
+            port_forward_handle->ServerStart(&context, request, &response);
+        !status.ok())
+      std::exit(1);
+    if (!response.server())
+      std::exit(1);
+    std::thread([&port_forwarder, server{response.server()}]() {
+      arpc::ServerBuilder builder(server);
+      builder.RegisterService(&port_forwarder);
+      std::unique_ptr<arpc::Server> port_forward_server(builder.Build());
+      while (port_forward_server->HandleRequest() == 0) {
+      }
+      std::exit(1);
+    }).detach();
+  }
+
   // Forward incoming connections to GRPC.
   GrpcConnectionInjector injector(cri_server.get());
   arpc::ServerBuilder injector_builder(response.server());
@@ -4,17 +4,29 @@
 
 #include "scuba/runtime_service/runtime_service.h"
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "grpc++/grpc++.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.grpc.pb.h"
+#include "scuba/runtime_service/cpu_set_allocator.h"
+#include "scuba/runtime_service/event_log.h"
+#include "scuba/runtime_service/log_ring.h"
+#include "scuba/runtime_service/events.pb.h"
+#include "scuba/runtime_service/journal.pb.h"
 #include "scuba/runtime_service/naming_scheme.h"
+#include "scuba/runtime_service/start_scheduler.h"
+#include "scuba/runtime_service/state_journal.h"
+#include "scuba/util/reclaimer.h"
 
 using grpc::ServerContext;
 using grpc::Status;
@@ -24,11 +36,16 @@ using runtime::AttachResponse;
 using runtime::ContainerConfig;
 using runtime::ContainerFilter;
 using runtime::ContainerState;
+using runtime::ContainerStatsFilter;
+using runtime::ContainerStatsRequest;
+using runtime::ContainerStatsResponse;
 using runtime::ContainerStatus;
 using runtime::ContainerStatusRequest;
 using runtime::ContainerStatusResponse;
 using runtime::CreateContainerRequest;
 using runtime::CreateContainerResponse;
+using runtime::ListContainerStatsRequest;
+using runtime::ListContainerStatsResponse;
 using runtime::ListContainersRequest;
 using runtime::ListContainersResponse;
 using runtime::ListPodSandboxRequest;
@@ -61,7 +78,180 @@ using runtime::UpdateRuntimeConfigRequest;
 using runtime::UpdateRuntimeConfigResponse;
 using runtime::VersionRequest;
 using runtime::VersionResponse;
+using scuba::events::EventType;
+using scuba::journal::Record;
+using scuba::runtime_service::FromJournalTime;
+using scuba::runtime_service::LogRing;
+using scuba::runtime_service::PodSandbox;
 using scuba::runtime_service::RuntimeService;
+using scuba::runtime_service::ToJournalTime;
+using scuba::util::Reclaimer;
+
+namespace {
+
+const std::string& GetContainerRecordPodSandboxId(const Record& record) {
+  switch (record.record_case()) {
+    case Record::kContainerCreated:
+      return record.container_created().pod_sandbox_id();
+    case Record::kContainerStarted:
+      return record.container_started().pod_sandbox_id();
+    case Record::kContainerExited:
+      return record.container_exited().pod_sandbox_id();
+    default:
+      return record.container_removed().pod_sandbox_id();
+  }
+}
+
+// Creates a pod sandbox that is destroyed in the background once the
+// last reference to it is dropped, as this involves destroying all of
+// its containers.
+template <typename... Args>
+std::shared_ptr<PodSandbox> CreatePodSandbox(Args&&... args) {
+  return std::shared_ptr<PodSandbox>(
+      new PodSandbox(std::forward<Args>(args)...), [](PodSandbox* pod_sandbox) {
+        Reclaimer::Default()->Retire(std::unique_ptr<PodSandbox>(pod_sandbox));
+      });
+}
+
+}  // namespace
+
+RuntimeService::~RuntimeService() {
+  // Pod sandboxes reference objects owned by the caller, so wait for
+  // them to be destroyed.
+  pod_sandboxes_.clear();
+  Reclaimer::Default()->Drain();
+}
+
+void RuntimeService::RestoreState() {
+  // Skip records that can no longer be applied, for example because
+  // the configuration of the runtime changed, instead of refusing to
+  // start. Any state that could be restored remains accessible.
+  state_journal_->Replay([this](const Record& record) {
+    try {
+      Restore_(record);
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to restore journal record: " << e.what()
+                << std::endl;
+    }
+  });
+
+  // Acquire resources for containers that were created, but not yet
+  // started before the restart.
+  std::shared_lock lock(pod_sandboxes_lock_);
+  for (const auto& pod_sandbox : pod_sandboxes_)
+    pod_sandbox.second->PrepareContainers(
+        *root_directory_, *image_directory_, switchboard_servers_);
+}
+
+void RuntimeService::CompactJournal() {
+  state_journal_->Compact([this](std::vector<Record>* records) {
+    std::shared_lock lock(pod_sandboxes_lock_);
+    if (!pod_cidr_.empty())
+      records->emplace_back().mutable_runtime_config_updated()->set_pod_cidr(
+          pod_cidr_);
+    for (const auto& pod_sandbox : pod_sandboxes_)
+      pod_sandbox.second->Snapshot(records);
+  });
+}
+
+std::shared_ptr<LogRing> RuntimeService::GetContainerOutput(
+    std::string_view container_id) {
+  auto ids = NamingScheme::DecomposePodSandboxContainerName(container_id);
+  std::shared_lock lock(pod_sandboxes_lock_);
+  auto pod_sandbox = pod_sandboxes_.find(ids.first);
+  if (pod_sandbox == pod_sandboxes_.end())
+    return nullptr;
+  return pod_sandbox->second->GetContainerOutput(ids.second);
+}
+
+std::shared_ptr<PodSandbox> RuntimeService::GetPodSandbox(
+    std::string_view pod_sandbox_id) {
+  std::shared_lock lock(pod_sandboxes_lock_);
+  auto pod_sandbox = pod_sandboxes_.find(pod_sandbox_id);
+  if (pod_sandbox == pod_sandboxes_.end())
+    return nullptr;
+  return pod_sandbox->second;
+}
+
+void RuntimeService::Restore_(const Record& record) {
+  std::unique_lock lock(pod_sandboxes_lock_);
+  switch (record.record_case()) {
+    case Record::kRuntimeConfigUpdated:
+      if (!ip_address_allocator_->SetRange(
+              record.runtime_config_updated().pod_cidr()))
+        throw std::invalid_argument("Failed to parse IP range");
+      pod_cidr_ = record.runtime_config_updated().pod_cidr();
+      break;
+    case Record::kPodSandboxCreated: {
+      const auto& created = record.pod_sandbox_created();
+      auto pod_sandbox = pod_sandboxes_.find(created.pod_sandbox_id());
+      if (pod_sandbox != pod_sandboxes_.end())
+        break;
+
+      // Attempt to hand out the same IP address as before. The range may
+      // have changed in the meantime, in which case a new one is needed.
+      IPAddressLease ip_address_lease;
+      try {
+        ip_address_lease = ip_address_allocator_->Reserve(created.ip_address());
+      } catch (const std::exception& e) {
+        std::cerr << "Failed to restore IP address of "
+                  << created.pod_sandbox_id() << ": " << e.what()
+                  << std::endl;
+        ip_address_lease = ip_address_allocator_->Allocate();
+      }
+      auto new_pod_sandbox = CreatePodSandbox(
+          created.pod_sandbox_id(), created.config(),
+          FromJournalTime(created.created_at()), std::move(ip_address_lease),
+          event_log_, state_journal_, cgroup_, cpu_set_allocator_,
+          start_scheduler_);
+      pod_sandboxes_.emplace(new_pod_sandbox->GetId(),
+                             std::move(new_pod_sandbox));
+      break;
+    }
+    case Record::kPodSandboxStopped: {
+      auto pod_sandbox =
+          pod_sandboxes_.find(record.pod_sandbox_stopped().pod_sandbox_id());
+      if (pod_sandbox != pod_sandboxes_.end())
+        pod_sandbox->second->Stop();
+      break;
+    }
+    case Record::kPodSandboxRemoved: {
+      auto pod_sandbox =
+          pod_sandboxes_.find(record.pod_sandbox_removed().pod_sandbox_id());
+      if (pod_sandbox != pod_sandboxes_.end()) {
+        std::shared_ptr<PodSandbox> removed = std::move(pod_sandbox->second);
+        pod_sandboxes_.erase(pod_sandbox);
+      }
+      break;
+    }
+    case Record::kContainerCreated:
+    case Record::kContainerStarted:
+    case Record::kContainerExited:
+    case Record::kContainerRemoved: {
+      auto pod_sandbox =
+          pod_sandboxes_.find(GetContainerRecordPodSandboxId(record));
+      if (pod_sandbox != pod_sandboxes_.end())
+        pod_sandbox->second->RestoreContainer(record);
+      break;
+    }
+    default:
+      std::cerr << "Ignoring unknown journal record" << std::endl;
+      break;
+  }
+}
+
+void RuntimeService::UpdateSharedCpus() {
+  if (cpu_set_allocator_ == nullptr)
+    return;
+  std::unique_lock shared_cpus_lock(shared_cpus_lock_);
+  std::string shared_cpus = cpu_set_allocator_->GetSharedCpus();
+  if (shared_cpus == shared_cpus_)
+    return;
+  shared_cpus_ = std::move(shared_cpus);
+  std::shared_lock lock(pod_sandboxes_lock_);
+  for (const auto& pod_sandbox : pod_sandboxes_)
+    pod_sandbox.second->SetSharedCpus(shared_cpus_);
+}
 
 Status RuntimeService::Version(ServerContext* context,
                                const VersionRequest* request,
@@ -105,10 +295,29 @@ Status RuntimeService::RunPodSandbox(ServerContext* context,
     } catch (const std::exception& e) {
       return {StatusCode::INTERNAL, e.what()};
     }
-    pod_sandboxes_.insert(
-        pod_sandbox, std::make_pair(pod_sandbox_id,
-                                    std::make_unique<PodSandbox>(
-                                        config, std::move(ip_address_lease))));
+    auto creation_time = std::chrono::system_clock::now();
+    std::uint32_t ip_address = ip_address_lease.GetAddress();
+    std::shared_ptr<PodSandbox> new_pod_sandbox;
+    try {
+      new_pod_sandbox = CreatePodSandbox(
+          pod_sandbox_id, config, creation_time, std::move(ip_address_lease),
+          event_log_, state_journal_, cgroup_, cpu_set_allocator_,
+          start_scheduler_);
+    } catch (const std::exception& e) {
+      return {StatusCode::INTERNAL, e.what()};
+    }
+    pod_sandboxes_.emplace(new_pod_sandbox->GetId(),
+                           std::move(new_pod_sandbox));
+    event_log_->Publish(EventType::POD_SANDBOX_CREATED, pod_sandbox_id);
+    if (state_journal_ != nullptr) {
+      Record record;
+      auto created = record.mutable_pod_sandbox_created();
+      created->set_pod_sandbox_id(pod_sandbox_id);
+      *created->mutable_config() = config;
+      created->set_created_at(ToJournalTime(creation_time));
+      created->set_ip_address(ip_address);
+      state_journal_->Append(record);
+    }
   }
 
   response->set_pod_sandbox_id(pod_sandbox_id);
@@ -118,19 +327,54 @@ Status RuntimeService::RunPodSandbox(ServerContext* context,
 Status RuntimeService::StopPodSandbox(ServerContext* context,
                                       const StopPodSandboxRequest* request,
                                       StopPodSandboxResponse* response) {
-  std::shared_lock lock(pod_sandboxes_lock_);
-  auto pod_sandbox = pod_sandboxes_.find(request->pod_sandbox_id());
-  if (pod_sandbox == pod_sandboxes_.end())
-    return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
-  pod_sandbox->second->Stop();
+  // Stopping a pod sandbox waits for its containers to terminate. Don't
+  // hold on to the lock while doing so, so that many pod sandboxes can
+  // be stopped in parallel without blocking other calls.
+  std::shared_ptr<PodSandbox> pod_sandbox;
+  {
+    std::shared_lock lock(pod_sandboxes_lock_);
+    auto lookup = pod_sandboxes_.find(request->pod_sandbox_id());
+    if (lookup == pod_sandboxes_.end())
+      return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
+    pod_sandbox = lookup->second;
+  }
+  if (pod_sandbox->Stop()) {
+    event_log_->Publish(EventType::POD_SANDBOX_STOPPED,
+                        request->pod_sandbox_id());
+    if (state_journal_ != nullptr) {
+      Record record;
+      record.mutable_pod_sandbox_stopped()->set_pod_sandbox_id(
+          request->pod_sandbox_id());
+      state_journal_->Append(record);
+    }
+  }
+  UpdateSharedCpus();
   return Status::OK;
 }
 
 Status RuntimeService::RemovePodSandbox(ServerContext* context,
                                         const RemovePodSandboxRequest* request,
                                         RemovePodSandboxResponse* response) {
-  std::unique_lock lock(pod_sandboxes_lock_);
-  pod_sandboxes_.erase(request->pod_sandbox_id());
+  // Only unlink the pod sandbox while holding the lock. Its containers,
+  // file descriptors and IP address lease are released in the
+  // background once no other requests reference it.
+  std::shared_ptr<PodSandbox> pod_sandbox;
+  {
+    std::unique_lock lock(pod_sandboxes_lock_);
+    auto lookup = pod_sandboxes_.find(request->pod_sandbox_id());
+    if (lookup == pod_sandboxes_.end())
+      return Status::OK;
+    pod_sandbox = std::move(lookup->second);
+    pod_sandboxes_.erase(lookup);
+    if (state_journal_ != nullptr) {
+      Record record;
+      record.mutable_pod_sandbox_removed()->set_pod_sandbox_id(
+          request->pod_sandbox_id());
+      state_journal_->Append(record);
+    }
+  }
+  event_log_->Publish(EventType::POD_SANDBOX_REMOVED,
+                      request->pod_sandbox_id());
   return Status::OK;
 }
 
@@ -168,7 +412,7 @@ Status RuntimeService::ListPodSandbox(ServerContext* context,
 
     runtime::PodSandbox* info = response->add_items();
     pod_sandbox.second->GetInfo(info);
-    info->set_id(pod_sandbox.first);
+    info->set_id(std::string(pod_sandbox.first));
   }
   return Status::OK;
 }
@@ -184,7 +428,15 @@ Status RuntimeService::CreateContainer(ServerContext* context,
   const ContainerConfig& config = request->config();
   std::string container_id =
       NamingScheme::CreateContainerName(config.metadata());
-  pod_sandbox->second->CreateContainer(container_id, config);
+  try {
+    pod_sandbox->second->CreateContainer(container_id, config,
+                                         *root_directory_, *image_directory_,
+                                         switchboard_servers_);
+  } catch (const std::invalid_argument& e) {
+    return {StatusCode::INVALID_ARGUMENT, e.what()};
+  } catch (const std::exception& e) {
+    return {StatusCode::INTERNAL, e.what()};
+  }
   response->set_container_id(NamingScheme::ComposePodSandboxContainerName(
       pod_sandbox->first, container_id));
   return Status::OK;
@@ -196,17 +448,23 @@ Status RuntimeService::StartContainer(ServerContext* context,
   auto ids =
       NamingScheme::DecomposePodSandboxContainerName(request->container_id());
   std::shared_lock lock(pod_sandboxes_lock_);
-  auto pod_sandbox = pod_sandboxes_.find(ids.first);
-  if (pod_sandbox == pod_sandboxes_.end())
+  auto pod_sandbox_entry = pod_sandboxes_.find(ids.first);
+  if (pod_sandbox_entry == pod_sandboxes_.end())
     return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
+  std::shared_ptr<PodSandbox> pod_sandbox = pod_sandbox_entry->second;
+  lock.unlock();
+
+  // Starting may need to wait for the container's resources, which are
+  // acquired subject to admission control. Don't hold on to the pod
+  // sandboxes while doing so, as the queue may be long.
   try {
-    pod_sandbox->second->StartContainer(
-        ids.second, *root_directory_, *image_directory_, switchboard_servers_);
+    pod_sandbox->StartContainer(ids.second);
   } catch (const std::invalid_argument& e) {
     return {StatusCode::INVALID_ARGUMENT, e.what()};
   } catch (const std::exception& e) {
     return {StatusCode::INTERNAL, e.what()};
   }
+  UpdateSharedCpus();
   return Status::OK;
 }
 
@@ -215,12 +473,21 @@ Status RuntimeService::StopContainer(ServerContext* context,
                                      StopContainerResponse* response) {
   auto ids =
       NamingScheme::DecomposePodSandboxContainerName(request->container_id());
-  std::shared_lock lock(pod_sandboxes_lock_);
-  auto pod_sandbox = pod_sandboxes_.find(ids.first);
-  if (pod_sandbox == pod_sandboxes_.end())
-    return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
-  if (!pod_sandbox->second->StopContainer(ids.second, request->timeout()))
+  // Stopping a container may block for the duration of its timeout.
+  // Don't hold on to the lock while doing so. This still occupies a
+  // thread of the synchronous gRPC server for every pending stop, as
+  // the call can only complete once the process has been reaped.
+  std::shared_ptr<PodSandbox> pod_sandbox;
+  {
+    std::shared_lock lock(pod_sandboxes_lock_);
+    auto lookup = pod_sandboxes_.find(ids.first);
+    if (lookup == pod_sandboxes_.end())
+      return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
+    pod_sandbox = lookup->second;
+  }
+  if (!pod_sandbox->StopContainer(ids.second, request->timeout()))
     return {StatusCode::NOT_FOUND, "Container does not exist"};
+  UpdateSharedCpus();
   return Status::OK;
 }
 
@@ -260,7 +527,7 @@ Status RuntimeService::ListContainers(ServerContext* context,
       *info_out = info_in.second;
       info_out->set_id(NamingScheme::ComposePodSandboxContainerName(
           pod_sandbox.first, info_in.first));
-      info_out->set_pod_sandbox_id(pod_sandbox.first);
+      info_out->set_pod_sandbox_id(std::string(pod_sandbox.first));
     }
   }
   return Status::OK;
@@ -282,24 +549,83 @@ Status RuntimeService::ContainerStatus(ServerContext* context,
   return Status::OK;
 }
 
+Status RuntimeService::ContainerStats(ServerContext* context,
+                                      const ContainerStatsRequest* request,
+                                      ContainerStatsResponse* response) {
+  const std::string& id = request->container_id();
+  auto ids = NamingScheme::DecomposePodSandboxContainerName(id);
+  if (ids.second.empty())
+    return {StatusCode::NOT_FOUND, "Container does not exist"};
+  std::shared_lock lock(pod_sandboxes_lock_);
+  auto pod_sandbox = pod_sandboxes_.find(ids.first);
+  if (pod_sandbox == pod_sandboxes_.end())
+    return {StatusCode::NOT_FOUND, "Pod sandbox does not exist"};
+  auto stats = pod_sandbox->second->GetContainerStats(ids.second, {});
+  if (stats.empty())
+    return {StatusCode::NOT_FOUND, "Container does not exist"};
+  *response->mutable_stats() = std::move(stats.front().second);
+  response->mutable_stats()->mutable_attributes()->set_id(id);
+  return Status::OK;
+}
+
+Status RuntimeService::ListContainerStats(
+    ServerContext* context, const ListContainerStatsRequest* request,
+    ListContainerStatsResponse* response) {
+  const ContainerStatsFilter& filter = request->filter();
+  auto ids = NamingScheme::DecomposePodSandboxContainerName(filter.id());
+  const std::string& pod_sandbox_id = filter.pod_sandbox_id();
+
+  std::shared_lock lock(pod_sandboxes_lock_);
+  for (const auto& pod_sandbox : pod_sandboxes_) {
+    // Apply filters.
+    if (!pod_sandbox_id.empty() && pod_sandbox_id != pod_sandbox.first)
+      continue;
+    if (!ids.first.empty() && ids.first != pod_sandbox.first)
+      continue;
+
+    for (auto& stats_in : pod_sandbox.second->GetContainerStats(
+             ids.second, filter.label_selector())) {
+      runtime::ContainerStats* stats_out = response->add_stats();
+      *stats_out = std::move(stats_in.second);
+      stats_out->mutable_attributes()->set_id(
+          NamingScheme::ComposePodSandboxContainerName(pod_sandbox.first,
+                                                       stats_in.first));
+    }
+  }
+  return Status::OK;
+}
+
 Status RuntimeService::Attach(ServerContext* context,
                               const AttachRequest* request,
                               AttachResponse* response) {
-  return {StatusCode::UNIMPLEMENTED, "Attach still needs to be implemented!"};
+  // Serving output over the streaming protocol used by kubectl is not
+  // supported. Output can be followed through scuba's own service.
+  return {StatusCode::UNIMPLEMENTED,
+          "Attach is only supported through scuba.attach.AttachService"};
 }
 
 Status RuntimeService::PortForward(ServerContext* context,
                                    const PortForwardRequest* request,
                                    PortForwardResponse* response) {
+  // Serving connections over the streaming protocol used by kubectl is
+  // not supported. Connections can be forwarded through Flower instead.
   return {StatusCode::UNIMPLEMENTED,
-          "PortForward still needs to be implemented!"};
+          "PortForward is only supported through the Flower switchboard"};
 }
 
 Status RuntimeService::UpdateRuntimeConfig(
     ServerContext* context, const UpdateRuntimeConfigRequest* request,
     UpdateRuntimeConfigResponse* response) {
-  if (!ip_address_allocator_->SetRange(
-          request->runtime_config().network_config().pod_cidr()))
+  const std::string& pod_cidr =
+      request->runtime_config().network_config().pod_cidr();
+  std::unique_lock lock(pod_sandboxes_lock_);
+  if (!ip_address_allocator_->SetRange(pod_cidr))
     return {StatusCode::INVALID_ARGUMENT, "Failed to parse IP range"};
+  pod_cidr_ = pod_cidr;
+  if (state_journal_ != nullptr) {
+    Record record;
+    record.mutable_runtime_config_updated()->set_pod_cidr(pod_cidr);
+    state_journal_->Append(record);
+  }
   return Status::OK;
 }
@@ -5,22 +5,32 @@
 #ifndef SCUBA_RUNTIME_SERVICE_RUNTIME_SERVICE_H
 #define SCUBA_RUNTIME_SERVICE_RUNTIME_SERVICE_H
 
-#include <map>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include "arpc++/arpc++.h"
 #include "flower/protocol/switchboard.ad.h"
 #include "grpc++/grpc++.h"
 #include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.grpc.pb.h"
+#include "scuba/runtime_service/journal.pb.h"
+#include "scuba/runtime_service/log_ring.h"
 #include "scuba/runtime_service/pod_sandbox.h"
+#include "scuba/util/lock_profiler.h"
 
 namespace scuba {
 namespace runtime_service {
 
+class Cgroup;
+class CpuSetAllocator;
+class EventLog;
 class IPAddressAllocator;
+class StartScheduler;
+class StateJournal;
 
 class RuntimeService final : public runtime::RuntimeService::Service {
  public:
@@ -28,12 +38,37 @@ class RuntimeService final : public runtime::RuntimeService::Service {
       const arpc::FileDescriptor* root_directory,
       const arpc::FileDescriptor* image_directory,
       flower::protocol::switchboard::Switchboard::Stub* switchboard_servers,
-      IPAddressAllocator* ip_address_allocator)
+      IPAddressAllocator* ip_address_allocator, EventLog* event_log,
+      StateJournal* state_journal, const Cgroup* cgroup,
+      CpuSetAllocator* cpu_set_allocator, StartScheduler* start_scheduler)
       : root_directory_(root_directory),
         image_directory_(image_directory),
         switchboard_servers_(switchboard_servers),
-        ip_address_allocator_(ip_address_allocator) {
+        ip_address_allocator_(ip_address_allocator),
+        event_log_(event_log),
+        state_journal_(state_journal),
+        cgroup_(cgroup),
+        cpu_set_allocator_(cpu_set_allocator),
+        start_scheduler_(start_scheduler),
+        pod_sandboxes_lock_("RuntimeService::pod_sandboxes_lock_") {
   }
+  ~RuntimeService();
+
+  // Recovers pod sandboxes and containers from the state journal. Must
+  // be called before the service starts processing requests.
+  void RestoreState();
+  // Rewrites the state journal, so that it no longer contains records
+  // of pod sandboxes and containers that have been removed.
+  void CompactJournal();
+  // Returns the recent output of a container, used by the attach
+  // service. Returns null if the container does not exist.
+  std::shared_ptr<LogRing> GetContainerOutput(std::string_view container_id);
+  // Returns a pod sandbox, used by the port forwarder. Returns null if
+  // the pod sandbox does not exist.
+  std::shared_ptr<PodSandbox> GetPodSandbox(std::string_view pod_sandbox_id);
+  // Moves containers to the CPUs that are shared, if they have changed
+  // since containers were started or stopped.
+  void UpdateSharedCpus();
 
   // Global state.
   grpc::Status Version(grpc::ServerContext* context,
@@ -89,6 +124,16 @@ class RuntimeService final : public runtime::RuntimeService::Service {
       const runtime::ContainerStatusRequest* request,
       runtime::ContainerStatusResponse* response) override;
 
+  // Resource usage.
+  grpc::Status ContainerStats(
+      grpc::ServerContext* context,
+      const runtime::ContainerStatsRequest* request,
+      runtime::ContainerStatsResponse* response) override;
+  grpc::Status ListContainerStats(
+      grpc::ServerContext* context,
+      const runtime::ListContainerStatsRequest* request,
+      runtime::ListContainerStatsResponse* response) override;
+
   // Misc.
   grpc::Status Attach(grpc::ServerContext* context,
                       const runtime::AttachRequest* request,
@@ -102,13 +147,31 @@ class RuntimeService final : public runtime::RuntimeService::Service {
       runtime::UpdateRuntimeConfigResponse* response) override;
 
  private:
+  void Restore_(const journal::Record& record);
+
   const arpc::FileDescriptor* const root_directory_;
   const arpc::FileDescriptor* const image_directory_;
   flower::protocol::switchboard::Switchboard::Stub* const switchboard_servers_;
   IPAddressAllocator* const ip_address_allocator_;
+  EventLog* const event_log_;
+  StateJournal* const state_journal_;
+  // Control group in which pod sandboxes create theirs, if any.
+  const Cgroup* const cgroup_;
+  // Allocator of CPUs that are assigned exclusively to containers, if
+  // placement is enabled. Requires a control group.
+  CpuSetAllocator* const cpu_set_allocator_;
+  std::mutex shared_cpus_lock_;
+  std::string shared_cpus_;
+  // Limits the number of containers that are started concurrently, if
+  // any.
+  StartScheduler* const start_scheduler_;
 
-  std::shared_mutex pod_sandboxes_lock_;
-  std::map<std::string, std::unique_ptr<PodSandbox>, std::less<>>
+  // Pod sandboxes are reference counted, so that long-running
+  // operations on them don't need to hold the lock on this map. They
+  // are keyed by the identifier stored in the pod sandbox itself.
+  util::ProfiledSharedMutex pod_sandboxes_lock_;
+  std::string pod_cidr_;
+  std::unordered_map<std::string_view, std::shared_ptr<PodSandbox>>
       pod_sandboxes_;
 
   RuntimeService(RuntimeService&) = delete;
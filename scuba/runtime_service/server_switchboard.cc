@@ -0,0 +1,70 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/server_switchboard.h"
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/switchboard.ad.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+#include "scuba/util/trace.h"
+
+using arpc::ClientContext;
+using arpc::FileDescriptor;
+using arpc::Status;
+using flower::protocol::switchboard::ConstrainRequest;
+using flower::protocol::switchboard::ConstrainResponse;
+using flower::protocol::switchboard::Right;
+using flower::protocol::switchboard::Switchboard;
+using runtime::ContainerMetadata;
+using runtime::PodSandboxMetadata;
+using scuba::util::TraceSpan;
+
+namespace scuba {
+namespace runtime_service {
+
+std::shared_ptr<FileDescriptor> ConstrainServerSwitchboard(
+    Switchboard::Stub* switchboard_servers,
+    const PodSandboxMetadata& pod_metadata,
+    const ContainerMetadata& container_metadata,
+    const std::map<std::string, std::string>& labels) {
+  // Constraints to be placed on the switchboard connection that is
+  // provided to the running process.
+  ConstrainRequest request;
+  request.add_rights(Right::SERVER_START);
+  auto in_labels = request.mutable_in_labels();
+  (*in_labels)["server_kubernetes_namespace"] = pod_metadata.namespace_();
+  (*in_labels)["server_kubernetes_pod_name"] = pod_metadata.name();
+  (*in_labels)["server_kubernetes_pod_attempt"] =
+      std::to_string(pod_metadata.attempt());
+  (*in_labels)["server_kubernetes_container_name"] = container_metadata.name();
+  (*in_labels)["server_kubernetes_container_attempt"] =
+      std::to_string(container_metadata.attempt());
+  for (const auto& label : labels)
+    if (!in_labels->emplace(label.first, label.second).second)
+      throw std::invalid_argument(
+          "Attempted to override predefined label \"" + label.first + '"');
+
+  // Request a new switchboard connection.
+  TraceSpan span("ConstrainServerSwitchboard",
+                 [&container_metadata]() { return container_metadata.name(); });
+  ClientContext context;
+  ConstrainResponse response;
+  if (Status status =
+          switchboard_servers->Constrain(&context, request, &response);
+      !status.ok())
+    throw std::runtime_error(
+        std::string("Failed to constrain switchboard channel: ") +
+        status.error_message());
+  if (!response.switchboard())
+    throw std::runtime_error("Switchboard did not return a file descriptor");
+  return response.switchboard();
+}
+
+}  // namespace runtime_service
+}  // namespace scuba
@@ -0,0 +1,33 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_SERVER_SWITCHBOARD_H
+#define SCUBA_RUNTIME_SERVICE_SERVER_SWITCHBOARD_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "arpc++/arpc++.h"
+#include "flower/protocol/switchboard.ad.h"
+#include "k8s.io/kubernetes/pkg/kubelet/apis/cri/v1alpha1/runtime/api.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Requests a switchboard connection through which a container may start
+// servers. Servers are labelled with the identity of the container, in
+// addition to the labels provided. Throws std::invalid_argument if the
+// provided labels attempt to override the predefined ones and
+// std::runtime_error if the switchboard fails to provide a connection.
+std::shared_ptr<arpc::FileDescriptor> ConstrainServerSwitchboard(
+    flower::protocol::switchboard::Switchboard::Stub* switchboard_servers,
+    const runtime::PodSandboxMetadata& pod_metadata,
+    const runtime::ContainerMetadata& container_metadata,
+    const std::map<std::string, std::string>& labels);
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/start_scheduler.h"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "scuba/util/metrics.h"
+
+using scuba::runtime_service::StartAdmission;
+using scuba::runtime_service::StartScheduler;
+using scuba::util::Gauge;
+using scuba::util::Histogram;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+Gauge* const queued_restarts = MetricsRegistry::Default()->GetGauge(
+    "scuba_container_start_queue_depth",
+    "Number of containers waiting to be started.", "kind=\"restart\"");
+Gauge* const queued_starts = MetricsRegistry::Default()->GetGauge(
+    "scuba_container_start_queue_depth",
+    "Number of containers waiting to be started.", "kind=\"start\"");
+Histogram* const restart_wait_duration =
+    MetricsRegistry::Default()->GetHistogram(
+        "scuba_container_start_wait_seconds",
+        "Time containers spent waiting to be started.", 1e-6,
+        "kind=\"restart\"");
+Histogram* const start_wait_duration =
+    MetricsRegistry::Default()->GetHistogram(
+        "scuba_container_start_wait_seconds",
+        "Time containers spent waiting to be started.", 1e-6,
+        "kind=\"start\"");
+
+}  // namespace
+
+StartAdmission::StartAdmission(StartAdmission&& admission) {
+  scheduler_ = admission.scheduler_;
+  admission.scheduler_ = nullptr;
+}
+
+StartAdmission::~StartAdmission() {
+  if (scheduler_ != nullptr)
+    scheduler_->Release();
+}
+
+StartAdmission& StartAdmission::operator=(StartAdmission&& admission) {
+  if (scheduler_ != nullptr)
+    scheduler_->Release();
+  scheduler_ = admission.scheduler_;
+  admission.scheduler_ = nullptr;
+  return *this;
+}
+
+StartAdmission StartScheduler::Admit(std::string_view pod_namespace,
+                                     bool restart) {
+  std::unique_lock lock(lock_);
+  Queue* queue = restart ? &restarts_ : &starts_;
+  if (running_ < max_concurrent_ && queue->order.empty() &&
+      (restart || restarts_.order.empty())) {
+    // Fast path: there is capacity and nobody to overtake.
+    ++running_;
+    (restart ? restart_wait_duration : start_wait_duration)->Observe(0);
+    return StartAdmission(this);
+  }
+
+  // Enqueue the container, creating a queue for the namespace if it
+  // has no other containers waiting.
+  Waiter waiter;
+  auto pending = queue->namespaces.find(pod_namespace);
+  if (pending == queue->namespaces.end()) {
+    pending = queue->namespaces.emplace(pod_namespace, std::deque<Waiter*>())
+                  .first;
+    queue->order.push_back(pending->first);
+  }
+  pending->second.push_back(&waiter);
+  Gauge* queued = restart ? queued_restarts : queued_starts;
+  queued->Add(1);
+
+  auto start = std::chrono::steady_clock::now();
+  waiter.cv.wait(lock, [&waiter]() { return waiter.admitted; });
+  queued->Add(-1);
+  (restart ? restart_wait_duration : start_wait_duration)
+      ->Observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count());
+  return StartAdmission(this);
+}
+
+void StartScheduler::Release() {
+  std::unique_lock lock(lock_);
+  --running_;
+  Dispatch_();
+}
+
+void StartScheduler::Dispatch_() {
+  while (running_ < max_concurrent_) {
+    Waiter* waiter = Dequeue_(&restarts_);
+    if (waiter == nullptr)
+      waiter = Dequeue_(&starts_);
+    if (waiter == nullptr)
+      return;
+    ++running_;
+    waiter->admitted = true;
+    waiter->cv.notify_one();
+  }
+}
+
+StartScheduler::Waiter* StartScheduler::Dequeue_(Queue* queue) {
+  if (queue->order.empty())
+    return nullptr;
+
+  // Take the first container of the namespace that is next in line,
+  // moving the namespace to the back if it has more containers waiting.
+  std::string pod_namespace = std::move(queue->order.front());
+  queue->order.pop_front();
+  auto pending = queue->namespaces.find(pod_namespace);
+  Waiter* waiter = pending->second.front();
+  pending->second.pop_front();
+  if (pending->second.empty())
+    queue->namespaces.erase(pending);
+  else
+    queue->order.push_back(std::move(pod_namespace));
+  return waiter;
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_START_SCHEDULER_H
+#define SCUBA_RUNTIME_SERVICE_START_SCHEDULER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace scuba {
+namespace runtime_service {
+
+class StartScheduler;
+
+// Permission to start a container, handed out by the start scheduler.
+// Releasing it allows the next queued container to be started.
+class StartAdmission {
+ public:
+  StartAdmission() : scheduler_(nullptr) {
+  }
+
+  explicit StartAdmission(StartScheduler* scheduler) : scheduler_(scheduler) {
+  }
+
+  StartAdmission(StartAdmission&& admission);
+  StartAdmission& operator=(StartAdmission&& admission);
+  ~StartAdmission();
+
+ private:
+  StartScheduler* scheduler_;
+
+  StartAdmission(const StartAdmission&) = delete;
+  StartAdmission& operator=(const StartAdmission&) = delete;
+};
+
+// Admission control for starting containers. Acquiring the resources
+// of a container involves disk I/O, parsing its configuration and
+// calls into the switchboard. Doing this for hundreds of containers at
+// once makes all of them slow, so only a limited number of containers
+// acquire their resources concurrently, whether this happens in the
+// background after creation or while being started.
+//
+// Queued containers are admitted round-robin across namespaces, so that
+// a single deployment scaling up cannot starve the others. Restarts of
+// containers in pods that are already running take priority over
+// containers that are started for the first time.
+class StartScheduler {
+ public:
+  explicit StartScheduler(std::size_t max_concurrent)
+      : max_concurrent_(max_concurrent), running_(0) {
+  }
+
+  // Blocks until the container may be started.
+  StartAdmission Admit(std::string_view pod_namespace, bool restart);
+  void Release();
+
+ private:
+  struct Waiter {
+    std::condition_variable cv;
+    bool admitted = false;
+  };
+
+  // Containers waiting to be started, grouped by namespace. Namespaces
+  // that have containers waiting are listed in the order in which they
+  // are served.
+  struct Queue {
+    std::map<std::string, std::deque<Waiter*>, std::less<>> namespaces;
+    std::deque<std::string> order;
+  };
+
+  void Dispatch_();
+  static Waiter* Dequeue_(Queue* queue);
+
+  const std::size_t max_concurrent_;
+
+  std::mutex lock_;
+  std::size_t running_;
+  Queue restarts_;
+  Queue starts_;
+
+  StartScheduler(StartScheduler&) = delete;
+  void operator=(StartScheduler) = delete;
+};
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,194 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/runtime_service/state_journal.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "arpc++/arpc++.h"
+#include "scuba/runtime_service/journal.pb.h"
+
+using arpc::FileDescriptor;
+using scuba::journal::Record;
+using scuba::runtime_service::StateJournal;
+
+namespace {
+
+// Magic string at the start of the journal file.
+constexpr char magic[8] = {'S', 'C', 'U', 'B', 'A', 'J', 'N', 'L'};
+
+// Granularity at which the journal file is grown.
+constexpr std::size_t growth = 1 << 20;
+
+}  // namespace
+
+StateJournal::StateJournal(const FileDescriptor* directory)
+    : directory_(directory),
+      base_(nullptr),
+      capacity_(0),
+      offset_(0),
+      compacted_size_(0),
+      replaying_(false) {
+  Open_("journal", O_CREAT);
+  compacted_size_ = offset_;
+}
+
+StateJournal::~StateJournal() {
+  if (base_ != nullptr)
+    munmap(base_, capacity_);
+}
+
+void StateJournal::Replay(const std::function<void(const Record&)>& apply) {
+  {
+    std::unique_lock lock(lock_);
+    replaying_ = true;
+  }
+
+  // Apply records until reaching the terminating zero length or a
+  // record that cannot be parsed.
+  std::size_t offset = sizeof(magic);
+  for (;;) {
+    std::uint32_t length;
+    if (capacity_ - offset < sizeof(length))
+      break;
+    std::memcpy(&length, base_ + offset, sizeof(length));
+    if (length == 0 || length > capacity_ - offset - sizeof(length))
+      break;
+    Record record;
+    if (!record.ParseFromArray(base_ + offset + sizeof(length), length))
+      break;
+    apply(record);
+    offset += sizeof(length) + length;
+  }
+  std::memset(base_ + offset, 0, capacity_ - offset);
+
+  std::unique_lock lock(lock_);
+  offset_ = offset;
+  compacted_size_ = offset;
+  replaying_ = false;
+}
+
+void StateJournal::Append(const Record& record) {
+  std::unique_lock lock(lock_);
+  if (!replaying_)
+    Write_(record);
+}
+
+bool StateJournal::NeedsCompaction() {
+  std::unique_lock lock(lock_);
+  return offset_ > 2 * compacted_size_ + growth;
+}
+
+void StateJournal::Compact(
+    const std::function<void(std::vector<Record>*)>& snapshot) {
+  // Create the snapshot without holding the lock, as doing so requires
+  // acquiring locks under which records are appended.
+  std::size_t tail;
+  {
+    std::unique_lock lock(lock_);
+    tail = offset_;
+  }
+  std::vector<Record> records;
+  snapshot(&records);
+
+  // Write the snapshot into a new file, followed by the records that
+  // were appended while creating the snapshot.
+  std::unique_lock lock(lock_);
+  std::unique_ptr<FileDescriptor> old_file = std::move(file_);
+  char* old_base = base_;
+  std::size_t old_capacity = capacity_;
+  std::size_t old_offset = offset_;
+  base_ = nullptr;
+  try {
+    Open_("journal.new", O_CREAT | O_TRUNC);
+    for (const Record& record : records)
+      Write_(record);
+    Reserve_(old_offset - tail);
+    std::memcpy(base_ + offset_, old_base + tail, old_offset - tail);
+    offset_ += old_offset - tail;
+    if (renameat(directory_->get(), "journal.new", directory_->get(),
+                 "journal") != 0)
+      throw std::system_error(errno, std::system_category(),
+                              "Failed to replace journal");
+  } catch (...) {
+    if (base_ != nullptr)
+      munmap(base_, capacity_);
+    file_ = std::move(old_file);
+    base_ = old_base;
+    capacity_ = old_capacity;
+    offset_ = old_offset;
+    throw;
+  }
+  munmap(old_base, old_capacity);
+  compacted_size_ = offset_;
+}
+
+void StateJournal::Open_(const char* name, int flags) {
+  int fd = openat(directory_->get(), name, flags | O_RDWR, 0600);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), name);
+  file_ = std::make_unique<FileDescriptor>(fd);
+  struct stat sb;
+  if (fstat(fd, &sb) != 0)
+    throw std::system_error(errno, std::system_category(), name);
+
+  // Map the existing contents of the file, adding a header if empty.
+  base_ = nullptr;
+  capacity_ = 0;
+  offset_ = 0;
+  Reserve_(std::max(std::size_t(sb.st_size), sizeof(magic)));
+  if (sb.st_size == 0)
+    std::memcpy(base_, magic, sizeof(magic));
+  else if (std::memcmp(base_, magic, sizeof(magic)) != 0)
+    throw std::runtime_error(std::string(name) + " is not a state journal");
+  offset_ = sizeof(magic);
+}
+
+void StateJournal::Reserve_(std::size_t length) {
+  // Ensure there is space for the record, followed by a zero length
+  // that terminates the journal.
+  std::size_t required = offset_ + length + sizeof(std::uint32_t);
+  if (required <= capacity_)
+    return;
+  std::size_t capacity =
+      std::max(2 * capacity_, (required + growth - 1) / growth * growth);
+  if (ftruncate(file_->get(), capacity) != 0)
+    throw std::system_error(errno, std::system_category(),
+                            "Failed to grow journal");
+  void* base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    file_->get(), 0);
+  if (base == MAP_FAILED)
+    throw std::system_error(errno, std::system_category(),
+                            "Failed to map journal");
+  if (base_ != nullptr)
+    munmap(base_, capacity_);
+  base_ = static_cast<char*>(base);
+  capacity_ = capacity;
+}
+
+void StateJournal::Write_(const Record& record) {
+  // Write the record before its length, so that a partially written
+  // record is never observed during replay.
+  std::uint32_t length = record.ByteSizeLong();
+  Reserve_(sizeof(length) + length);
+  record.SerializeWithCachedSizesToArray(
+      reinterpret_cast<std::uint8_t*>(base_ + offset_ + sizeof(length)));
+  std::memcpy(base_ + offset_, &length, sizeof(length));
+  offset_ += sizeof(length) + length;
+}
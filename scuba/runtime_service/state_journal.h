@@ -0,0 +1,76 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_RUNTIME_SERVICE_STATE_JOURNAL_H
+#define SCUBA_RUNTIME_SERVICE_STATE_JOURNAL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "arpc++/arpc++.h"
+#include "scuba/runtime_service/journal.pb.h"
+
+namespace scuba {
+namespace runtime_service {
+
+// Append-only journal of mutations of the runtime service's state,
+// stored in a memory-mapped file. Records are framed by a length that
+// is written after the record itself, so that a record that was only
+// partially written when the process terminated is never replayed.
+class StateJournal {
+ public:
+  explicit StateJournal(const arpc::FileDescriptor* directory);
+  ~StateJournal();
+
+  // Invokes a function for every record in the journal. Records
+  // appended while replaying are discarded.
+  void Replay(const std::function<void(const journal::Record&)>& apply);
+  void Append(const journal::Record& record);
+
+  // Replaces the journal by a snapshot of the current state. Records
+  // appended while the snapshot is being created are retained.
+  bool NeedsCompaction();
+  void Compact(
+      const std::function<void(std::vector<journal::Record>*)>& snapshot);
+
+ private:
+  void Open_(const char* name, int flags);
+  void Reserve_(std::size_t length);
+  void Write_(const journal::Record& record);
+
+  const arpc::FileDescriptor* const directory_;
+
+  std::mutex lock_;
+  std::unique_ptr<arpc::FileDescriptor> file_;
+  char* base_;
+  std::size_t capacity_;
+  std::size_t offset_;
+  std::size_t compacted_size_;
+  bool replaying_;
+
+  StateJournal(StateJournal&) = delete;
+  void operator=(StateJournal) = delete;
+};
+
+// Timestamps are stored in records as nanoseconds since the epoch.
+inline std::int64_t ToJournalTime(std::chrono::system_clock::time_point time) {
+  return std::chrono::nanoseconds(time.time_since_epoch()).count();
+}
+
+inline std::chrono::system_clock::time_point FromJournalTime(
+    std::int64_t time) {
+  return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(time)));
+}
+
+}  // namespace runtime_service
+}  // namespace scuba
+
+#endif
@@ -4,8 +4,10 @@
 
 #include "scuba/runtime_service/yaml_file_descriptor_factory.h"
 
-#include <algorithm>
-#include <sstream>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -13,15 +15,12 @@
 
 #include "argdata.hpp"
 #include "arpc++/arpc++.h"
-#include "flower/protocol/switchboard.ad.h"
+#include "scuba/runtime_service/server_switchboard.h"
 #include "yaml-cpp/exceptions.h"
 #include "yaml-cpp/mark.h"
 
-using arpc::ClientContext;
-using arpc::Status;
-using flower::protocol::switchboard::ConstrainRequest;
-using flower::protocol::switchboard::ConstrainResponse;
-using flower::protocol::switchboard::Right;
+using arpc::FileDescriptor;
+using scuba::runtime_service::ConstrainServerSwitchboard;
 using scuba::runtime_service::YAMLFileDescriptorFactory;
 
 const argdata_t* YAMLFileDescriptorFactory::GetNull(const YAML::Mark& mark) {
@@ -55,47 +54,26 @@ const argdata_t* YAMLFileDescriptorFactory::GetMap(
     const YAML::Mark& mark, std::string_view tag,
     std::vector<const argdata_t*> keys, std::vector<const argdata_t*> values) {
   if (tag == "tag:nuxi.nl,2015:cloudabi/kubernetes/server") {
-    // Constraints to be placed on the switchboard connection that is
-    // provided to the running process.
-    ConstrainRequest request;
-    request.add_rights(Right::SERVER_START);
-    auto labels = request.mutable_in_labels();
-    (*labels)["server_kubernetes_namespace"] = pod_metadata_->namespace_();
-    (*labels)["server_kubernetes_pod_name"] = pod_metadata_->name();
-    (*labels)["server_kubernetes_pod_attempt"] =
-        std::to_string(pod_metadata_->attempt());
-    (*labels)["server_kubernetes_container_name"] = container_metadata_->name();
-    (*labels)["server_kubernetes_container_attempt"] =
-        std::to_string(container_metadata_->attempt());
+    std::map<std::string, std::string> labels;
     for (size_t i = 0; i < keys.size(); ++i) {
       std::optional<std::string_view> key = keys[i]->get_str();
       std::optional<std::string_view> value = values[i]->get_str();
       if (!key || !value)
         throw YAML::ParserException(
             mark, "Switchboard label keys and values must be strings");
-      if (!labels->emplace(*key, *value).second) {
-        std::ostringstream ss;
-        ss << "Attempted to override predefined label \"" << *key << '"';
-        throw YAML::ParserException(mark, ss.str());
-      }
+      labels.emplace(*key, *value);
     }
 
-    // Request a new switchboard connection.
-    ClientContext context;
-    ConstrainResponse response;
-    if (Status status =
-            switchboard_servers_->Constrain(&context, request, &response);
-        !status.ok())
-      throw YAML::ParserException(
-          mark, std::string("Failed to constrain switchboard channel: ") +
-                    status.error_message());
-    if (!response.switchboard())
-      throw YAML::ParserException(
-          mark, "Switchboard did not return a file descriptor");
-
+    std::shared_ptr<FileDescriptor> switchboard;
+    try {
+      switchboard = ConstrainServerSwitchboard(
+          switchboard_servers_, *pod_metadata_, *container_metadata_, labels);
+    } catch (const std::exception& e) {
+      throw YAML::ParserException(mark, e.what());
+    }
     return argdatas_
-        .emplace_back(argdata_t::create_fd(
-            fds_.emplace_back(response.switchboard())->get()))
+        .emplace_back(
+            argdata_t::create_fd(fds_.emplace_back(switchboard)->get()))
         .get();
   } else {
     return fallback_->GetMap(mark, tag, std::move(keys), std::move(values));
@@ -0,0 +1,155 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_GRPC_METRICS_INTERCEPTOR_H
+#define SCUBA_UTIL_GRPC_METRICS_INTERCEPTOR_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "grpc++/grpc++.h"
+#include "grpcpp/support/server_interceptor.h"
+#include "scuba/util/lock_profiler.h"
+#include "scuba/util/metrics.h"
+
+namespace scuba {
+namespace util {
+
+// Server interceptor that records the latency and the resulting status
+// code of every call made to a GRPC server.
+class GrpcMetricsInterceptorFactory
+    : public grpc::experimental::ServerInterceptorFactoryInterface {
+ public:
+  explicit GrpcMetricsInterceptorFactory(MetricsRegistry* registry)
+      : registry_(registry) {
+  }
+
+  grpc::experimental::Interceptor* CreateServerInterceptor(
+      grpc::experimental::ServerRpcInfo* info) override {
+    const char* method = info->method();
+    return new Interceptor(
+        GetMethodMetrics_(method == nullptr ? "" : method));
+  }
+
+ private:
+  // Metrics of a single method, cached so that the registry only needs
+  // to be consulted the first time a method returns a status code.
+  struct MethodMetrics {
+    std::string method;
+    std::string labels;
+    MetricsRegistry* registry;
+    Histogram* latency;
+    std::array<std::atomic<Counter*>, grpc::StatusCode::UNAUTHENTICATED + 1>
+        handled{};
+  };
+
+  class Interceptor : public grpc::experimental::Interceptor {
+   public:
+    explicit Interceptor(MethodMetrics* metrics)
+        : metrics_(metrics), start_(std::chrono::steady_clock::now()) {
+    }
+
+    void Intercept(
+        grpc::experimental::InterceptorBatchMethods* methods) override {
+      // Synchronous handlers run on the thread that received the
+      // request. Attribute the locks they hold to the method.
+      if (methods->QueryInterceptionHookPoint(
+              grpc::experimental::InterceptionHookPoints::POST_RECV_MESSAGE))
+        LockProfiler::SetOperation(metrics_->method.c_str());
+      if (methods->QueryInterceptionHookPoint(
+              grpc::experimental::InterceptionHookPoints::PRE_SEND_STATUS)) {
+        metrics_->latency->Observe(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_)
+                .count());
+        LockProfiler::SetOperation(nullptr);
+        std::size_t code = methods->GetSendStatus().error_code();
+        if (code < metrics_->handled.size()) {
+          Counter* handled = metrics_->handled[code].load();
+          if (handled == nullptr) {
+            static const char* const names[] = {
+                "OK",
+                "CANCELLED",
+                "UNKNOWN",
+                "INVALID_ARGUMENT",
+                "DEADLINE_EXCEEDED",
+                "NOT_FOUND",
+                "ALREADY_EXISTS",
+                "PERMISSION_DENIED",
+                "RESOURCE_EXHAUSTED",
+                "FAILED_PRECONDITION",
+                "ABORTED",
+                "OUT_OF_RANGE",
+                "UNIMPLEMENTED",
+                "INTERNAL",
+                "UNAVAILABLE",
+                "DATA_LOSS",
+                "UNAUTHENTICATED",
+            };
+            handled = metrics_->registry->GetCounter(
+                "scuba_grpc_server_handled_total",
+                "Number of GRPC calls completed, by status code.",
+                metrics_->labels + ",grpc_code=\"" + names[code] + "\"");
+            metrics_->handled[code].store(handled);
+          }
+          handled->Increment();
+        }
+      }
+      methods->Proceed();
+    }
+
+   private:
+    MethodMetrics* const metrics_;
+    const std::chrono::steady_clock::time_point start_;
+  };
+
+  MethodMetrics* GetMethodMetrics_(std::string_view method) {
+    {
+      std::shared_lock lock(lock_);
+      auto metrics = methods_.find(method);
+      if (metrics != methods_.end())
+        return metrics->second.get();
+    }
+
+    // Method names have the form "/package.Service/Method".
+    auto metrics = std::make_unique<MethodMetrics>();
+    metrics->method = method;
+    std::size_t split = method.rfind('/');
+    std::string_view service =
+        split == std::string_view::npos ? std::string_view()
+                                        : method.substr(0, split);
+    if (!service.empty() && service.front() == '/')
+      service.remove_prefix(1);
+    metrics->labels = "grpc_service=\"" + std::string(service) +
+                      "\",grpc_method=\"" +
+                      std::string(method.substr(split + 1)) + "\"";
+    metrics->registry = registry_;
+    metrics->latency = registry_->GetHistogram(
+        "scuba_grpc_server_handling_seconds",
+        "Latency of GRPC calls, up to the point the status is sent.", 1e-6,
+        metrics->labels);
+
+    std::unique_lock lock(lock_);
+    std::string_view key = metrics->method;
+    return methods_.emplace(key, std::move(metrics)).first->second.get();
+  }
+
+  MetricsRegistry* const registry_;
+
+  std::shared_mutex lock_;
+  std::unordered_map<std::string_view, std::unique_ptr<MethodMetrics>>
+      methods_;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
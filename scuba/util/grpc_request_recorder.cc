@@ -0,0 +1,66 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/grpc_request_recorder.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/message.h"
+#include "grpcpp/support/server_interceptor.h"
+#include "scuba/util/request_log.pb.h"
+
+using google::protobuf::Message;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using grpc::experimental::InterceptionHookPoints;
+using grpc::experimental::InterceptorBatchMethods;
+using scuba::request_log::Call;
+using scuba::util::GrpcRequestRecorderFactory;
+
+void GrpcRequestRecorderFactory::Interceptor::Intercept(
+    InterceptorBatchMethods* methods) {
+  if (methods->QueryInterceptionHookPoint(
+          InterceptionHookPoints::POST_RECV_MESSAGE)) {
+    if (const Message* request =
+            static_cast<const Message*>(methods->GetRecvMessage());
+        request != nullptr)
+      request->SerializeToString(call_.mutable_request());
+  }
+  if (methods->QueryInterceptionHookPoint(
+          InterceptionHookPoints::PRE_SEND_STATUS)) {
+    call_.set_latency(std::chrono::nanoseconds(
+                          std::chrono::steady_clock::now() - start_)
+                          .count());
+    call_.set_status_code(methods->GetSendStatus().error_code());
+    factory_->Write_(call_);
+  }
+  methods->Proceed();
+}
+
+void GrpcRequestRecorderFactory::Write_(const Call& call) {
+  std::string data;
+  {
+    StringOutputStream stream(&data);
+    CodedOutputStream output(&stream);
+    output.WriteVarint32(call.ByteSizeLong());
+    call.SerializeToCodedStream(&output);
+  }
+
+  // Recording is best effort. Write errors are ignored, so that they
+  // don't affect the processing of calls.
+  std::unique_lock lock(lock_);
+  for (std::string_view remaining = data; !remaining.empty();) {
+    ssize_t written = write(output_->get(), remaining.data(), remaining.size());
+    if (written <= 0)
+      break;
+    remaining.remove_prefix(written);
+  }
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_GRPC_REQUEST_RECORDER_H
+#define SCUBA_UTIL_GRPC_REQUEST_RECORDER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "arpc++/arpc++.h"
+#include "grpc++/grpc++.h"
+#include "grpcpp/support/server_interceptor.h"
+#include "scuba/util/request_log.pb.h"
+
+namespace scuba {
+namespace util {
+
+// Server interceptor that appends every unary call made to a GRPC
+// server to a request log, so that it can be replayed later.
+class GrpcRequestRecorderFactory
+    : public grpc::experimental::ServerInterceptorFactoryInterface {
+ public:
+  explicit GrpcRequestRecorderFactory(
+      std::shared_ptr<arpc::FileDescriptor> output)
+      : output_(std::move(output)) {
+  }
+
+  grpc::experimental::Interceptor* CreateServerInterceptor(
+      grpc::experimental::ServerRpcInfo* info) override {
+    // Streaming calls cannot be replayed meaningfully.
+    if (info->type() != grpc::experimental::ServerRpcInfo::Type::UNARY ||
+        info->method() == nullptr)
+      return nullptr;
+    return new Interceptor(this, info->method());
+  }
+
+ private:
+  class Interceptor : public grpc::experimental::Interceptor {
+   public:
+    Interceptor(GrpcRequestRecorderFactory* factory, const char* method)
+        : factory_(factory), start_(std::chrono::steady_clock::now()) {
+      call_.set_method(method);
+      call_.set_received_at(std::chrono::nanoseconds(
+                                std::chrono::system_clock::now()
+                                    .time_since_epoch())
+                                .count());
+    }
+
+    void Intercept(
+        grpc::experimental::InterceptorBatchMethods* methods) override;
+
+   private:
+    GrpcRequestRecorderFactory* const factory_;
+    const std::chrono::steady_clock::time_point start_;
+    request_log::Call call_;
+  };
+
+  void Write_(const request_log::Call& call);
+
+  const std::shared_ptr<arpc::FileDescriptor> output_;
+  std::mutex lock_;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
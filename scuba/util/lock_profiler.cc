@@ -0,0 +1,157 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/lock_profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "scuba/util/metrics.h"
+
+using scuba::util::Histogram;
+using scuba::util::LockProfile;
+using scuba::util::LockProfiler;
+using scuba::util::ProfiledSharedMutex;
+
+namespace {
+
+// Shared locks held by the current thread while profiling, along with
+// the time at which they were acquired.
+thread_local std::vector<std::pair<const void*, LockProfile::Clock::time_point>>
+    shared_holds;
+
+// Prints the count, mean and approximate quantiles of a histogram of
+// durations in nanoseconds. Quantiles are rounded up to the upper
+// bound of the bucket in which they are located.
+void WriteDurations(std::ostream* output, const char* name,
+                    const Histogram& histogram) {
+  std::array<std::uint64_t, Histogram::kBuckets> buckets;
+  std::uint64_t sum;
+  histogram.Get(&buckets, &sum);
+  std::uint64_t count = 0;
+  for (std::uint64_t bucket : buckets)
+    count += bucket;
+  *output << "  " << name << ": count=" << count;
+  if (count == 0) {
+    *output << "\n";
+    return;
+  }
+  *output << " total=" << sum << "ns mean=" << sum / count << "ns";
+  for (auto [label, quantile] : {std::pair("p50", 0.5), std::pair("p90", 0.9),
+                                 std::pair("p99", 0.99)}) {
+    std::uint64_t seen = 0;
+    std::size_t bucket = 0;
+    while (bucket < buckets.size() - 1 &&
+           (seen += buckets[bucket]) < quantile * count)
+      ++bucket;
+    *output << " " << label << "<=";
+    if (bucket == buckets.size() - 1)
+      *output << "inf";
+    else
+      *output << (std::uint64_t(1) << bucket) << "ns";
+  }
+  *output << "\n";
+}
+
+}  // namespace
+
+void LockProfile::RecordHold(Clock::duration hold, bool shared) {
+  std::chrono::nanoseconds duration(hold);
+  (shared ? shared_hold_ : exclusive_hold_).Observe(duration.count());
+
+  if (duration.count() <=
+      shortest_retained_hold_.load(std::memory_order_relaxed))
+    return;
+  std::unique_lock lock(longest_holds_lock_);
+  longest_holds_.push_back(
+      Hold{duration, LockProfiler::GetOperation(), shared});
+  std::sort(longest_holds_.begin(), longest_holds_.end(),
+            [](const Hold& a, const Hold& b) {
+              return a.duration > b.duration;
+            });
+  if (longest_holds_.size() > kLongestHolds) {
+    longest_holds_.pop_back();
+    shortest_retained_hold_.store(longest_holds_.back().duration.count(),
+                                  std::memory_order_relaxed);
+  }
+}
+
+void LockProfile::WriteText(std::ostream* output) {
+  *output << name_ << "\n";
+  WriteDurations(output, "wait", wait_);
+  WriteDurations(output, "exclusive hold", exclusive_hold_);
+  WriteDurations(output, "shared hold", shared_hold_);
+  std::unique_lock lock(longest_holds_lock_);
+  for (const Hold& hold : longest_holds_)
+    *output << "  longest hold: " << hold.duration.count() << "ns "
+            << (hold.shared ? "shared" : "exclusive") << " by "
+            << hold.operation << "\n";
+}
+
+thread_local const char* LockProfiler::current_operation_ = nullptr;
+
+LockProfiler* LockProfiler::Default() {
+  static LockProfiler profiler;
+  return &profiler;
+}
+
+LockProfile* LockProfiler::GetProfile(std::string_view name) {
+  std::unique_lock lock(lock_);
+  auto profile = profiles_.find(name);
+  if (profile == profiles_.end())
+    profile = profiles_
+                  .emplace(name, std::make_unique<LockProfile>(
+                                     std::string(name)))
+                  .first;
+  return profile->second.get();
+}
+
+void LockProfiler::WriteText(std::ostream* output) {
+  std::unique_lock lock(lock_);
+  for (const auto& profile : profiles_)
+    profile.second->WriteText(output);
+}
+
+void ProfiledSharedMutex::lock_shared() {
+  if (!LockProfiler::Default()->IsEnabled()) {
+    mutex_.lock_shared();
+    return;
+  }
+  auto start = LockProfile::Clock::now();
+  mutex_.lock_shared();
+  auto acquired = LockProfile::Clock::now();
+  shared_holds.emplace_back(this, acquired);
+  profile_->RecordWait(acquired - start);
+}
+
+bool ProfiledSharedMutex::try_lock_shared() {
+  if (!mutex_.try_lock_shared())
+    return false;
+  if (LockProfiler::Default()->IsEnabled())
+    shared_holds.emplace_back(this, LockProfile::Clock::now());
+  return true;
+}
+
+void ProfiledSharedMutex::unlock_shared() {
+  // Only record the hold if profiling was enabled during acquisition.
+  auto hold = std::find_if(shared_holds.rbegin(), shared_holds.rend(),
+                           [this](const auto& hold) {
+                             return hold.first == this;
+                           });
+  if (hold != shared_holds.rend()) {
+    profile_->RecordHold(LockProfile::Clock::now() - hold->second, true);
+    shared_holds.erase(std::next(hold).base());
+  }
+  mutex_.unlock_shared();
+}
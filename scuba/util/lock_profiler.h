@@ -0,0 +1,184 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_LOCK_PROFILER_H
+#define SCUBA_UTIL_LOCK_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "scuba/util/metrics.h"
+
+namespace scuba {
+namespace util {
+
+// Statistics on how long threads waited for and held a lock, aggregated
+// over all locks sharing the same name.
+class LockProfile {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Number of longest holds that are retained.
+  static constexpr std::size_t kLongestHolds = 8;
+
+  explicit LockProfile(std::string name)
+      : name_(std::move(name)), shortest_retained_hold_(0) {
+  }
+
+  void RecordWait(Clock::duration wait) {
+    wait_.Observe(std::chrono::nanoseconds(wait).count());
+  }
+  void RecordHold(Clock::duration hold, bool shared);
+  void WriteText(std::ostream* output);
+
+ private:
+  struct Hold {
+    std::chrono::nanoseconds duration;
+    const char* operation;
+    bool shared;
+  };
+
+  const std::string name_;
+  Histogram wait_;
+  Histogram exclusive_hold_;
+  Histogram shared_hold_;
+
+  // Holds that took the longest. Holds that are shorter than the
+  // shortest one retained are discarded without acquiring the lock.
+  std::atomic<std::int64_t> shortest_retained_hold_;
+  std::mutex longest_holds_lock_;
+  std::vector<Hold> longest_holds_;
+
+  LockProfile(LockProfile&) = delete;
+  void operator=(LockProfile) = delete;
+};
+
+// Registry of lock profiles, which can be dumped for debugging. As
+// profiling adds a couple of clock readings to every acquisition, it is
+// disabled by default.
+class LockProfiler {
+ public:
+  LockProfiler() : enabled_(false) {
+  }
+
+  // Profiler shared by all components of a process.
+  static LockProfiler* Default();
+
+  bool IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Enables or disables profiling. Statistics gathered previously are
+  // retained, so that profiling can be paused.
+  void SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  LockProfile* GetProfile(std::string_view name);
+  void WriteText(std::ostream* output);
+
+  // Sets the name of the operation performed by the current thread, to
+  // which the longest holds of locks are attributed. The name must
+  // remain valid for the lifetime of the process.
+  static void SetOperation(const char* operation) {
+    current_operation_ = operation;
+  }
+  static const char* GetOperation() {
+    return current_operation_ == nullptr ? "(unknown)" : current_operation_;
+  }
+
+ private:
+  static thread_local const char* current_operation_;
+
+  std::atomic<bool> enabled_;
+
+  std::mutex lock_;
+  std::map<std::string, std::unique_ptr<LockProfile>, std::less<>> profiles_;
+
+  LockProfiler(LockProfiler&) = delete;
+  void operator=(LockProfiler) = delete;
+};
+
+// Mutex that records its wait and hold times in a lock profile when
+// profiling is enabled.
+template <typename Mutex>
+class BasicProfiledMutex {
+ public:
+  explicit BasicProfiledMutex(std::string_view name)
+      : profile_(LockProfiler::Default()->GetProfile(name)), profiled_(false) {
+  }
+
+  void lock() {
+    if (!LockProfiler::Default()->IsEnabled()) {
+      mutex_.lock();
+      profiled_ = false;
+      return;
+    }
+    auto start = LockProfile::Clock::now();
+    mutex_.lock();
+    acquired_ = LockProfile::Clock::now();
+    profiled_ = true;
+    profile_->RecordWait(acquired_ - start);
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock())
+      return false;
+    profiled_ = LockProfiler::Default()->IsEnabled();
+    if (profiled_)
+      acquired_ = LockProfile::Clock::now();
+    return true;
+  }
+
+  void unlock() {
+    if (profiled_) {
+      profiled_ = false;
+      profile_->RecordHold(LockProfile::Clock::now() - acquired_, false);
+    }
+    mutex_.unlock();
+  }
+
+ protected:
+  Mutex mutex_;
+  LockProfile* const profile_;
+
+ private:
+  // Fields only accessed by the thread holding the lock exclusively.
+  bool profiled_;
+  LockProfile::Clock::time_point acquired_;
+
+  BasicProfiledMutex(BasicProfiledMutex&) = delete;
+  void operator=(BasicProfiledMutex) = delete;
+};
+
+using ProfiledMutex = BasicProfiledMutex<std::mutex>;
+
+// Shared mutex that also records wait and hold times of shared locks.
+class ProfiledSharedMutex : public BasicProfiledMutex<std::shared_mutex> {
+ public:
+  explicit ProfiledSharedMutex(std::string_view name)
+      : BasicProfiledMutex(name) {
+  }
+
+  // Shared holds may overlap, so their starting times are tracked per
+  // thread instead of in the mutex itself.
+  void lock_shared();
+  bool try_lock_shared();
+  void unlock_shared();
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
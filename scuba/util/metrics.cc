@@ -0,0 +1,186 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/metrics.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "arpc++/arpc++.h"
+
+using arpc::FileDescriptor;
+using scuba::util::Counter;
+using scuba::util::Gauge;
+using scuba::util::Histogram;
+using scuba::util::MetricsRegistry;
+
+namespace {
+
+// Formats a set of labels, omitting the braces if the set is empty.
+std::string FormatLabels(std::string_view labels) {
+  return labels.empty() ? std::string() : "{" + std::string(labels) + "}";
+}
+
+}  // namespace
+
+std::uint64_t Counter::Get() const {
+  std::uint64_t value = 0;
+  for (const auto& shard : shards_)
+    value += shard.value.load(std::memory_order_relaxed);
+  return value;
+}
+
+void Histogram::Get(std::array<std::uint64_t, kBuckets>* buckets,
+                    std::uint64_t* sum) const {
+  buckets->fill(0);
+  *sum = 0;
+  for (const auto& shard : shards_) {
+    for (std::size_t i = 0; i < kBuckets; ++i)
+      (*buckets)[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    *sum += shard.sum.load(std::memory_order_relaxed);
+  }
+}
+
+MetricsRegistry* MetricsRegistry::Default() {
+  static MetricsRegistry registry;
+  return &registry;
+}
+
+Counter* MetricsRegistry::GetCounter(std::string_view name,
+                                     std::string_view help,
+                                     std::string_view labels) {
+  std::unique_lock lock(lock_);
+  auto family = families_.find(name);
+  if (family == families_.end())
+    family = families_.emplace(name, Family{std::string(help), 1.0}).first;
+  else if (!family->second.gauges.empty() ||
+           !family->second.histograms.empty())
+    throw std::logic_error(std::string(name) + " is not a counter");
+
+  auto& counters = family->second.counters;
+  auto counter = counters.find(labels);
+  if (counter == counters.end())
+    counter = counters.emplace(labels, std::make_unique<Counter>()).first;
+  return counter->second.get();
+}
+
+Gauge* MetricsRegistry::GetGauge(std::string_view name, std::string_view help,
+                                 std::string_view labels) {
+  std::unique_lock lock(lock_);
+  auto family = families_.find(name);
+  if (family == families_.end())
+    family = families_.emplace(name, Family{std::string(help), 1.0}).first;
+  else if (!family->second.counters.empty() ||
+           !family->second.histograms.empty())
+    throw std::logic_error(std::string(name) + " is not a gauge");
+
+  auto& gauges = family->second.gauges;
+  auto gauge = gauges.find(labels);
+  if (gauge == gauges.end())
+    gauge = gauges.emplace(labels, std::make_unique<Gauge>()).first;
+  return gauge->second.get();
+}
+
+Histogram* MetricsRegistry::GetHistogram(std::string_view name,
+                                         std::string_view help, double scale,
+                                         std::string_view labels) {
+  std::unique_lock lock(lock_);
+  auto family = families_.find(name);
+  if (family == families_.end())
+    family = families_.emplace(name, Family{std::string(help), scale}).first;
+  else if (!family->second.counters.empty() ||
+           !family->second.gauges.empty())
+    throw std::logic_error(std::string(name) + " is not a histogram");
+
+  auto& histograms = family->second.histograms;
+  auto histogram = histograms.find(labels);
+  if (histogram == histograms.end())
+    histogram =
+        histograms.emplace(labels, std::make_unique<Histogram>()).first;
+  return histogram->second.get();
+}
+
+void MetricsRegistry::WriteText(std::ostream* output) {
+  std::unique_lock lock(lock_);
+  for (const auto& family : families_) {
+    const std::string& name = family.first;
+    *output << "# HELP " << name << " " << family.second.help << "\n";
+    if (!family.second.histograms.empty()) {
+      *output << "# TYPE " << name << " histogram\n";
+      for (const auto& histogram : family.second.histograms) {
+        std::string labels = histogram.first;
+        if (!labels.empty())
+          labels += ',';
+        std::array<std::uint64_t, Histogram::kBuckets> buckets;
+        std::uint64_t sum;
+        histogram.second->Get(&buckets, &sum);
+
+        // Prometheus expects cumulative counts per bucket. The last
+        // bucket contains all values that didn't fit in the others.
+        std::uint64_t count = 0;
+        for (std::size_t i = 0; i < buckets.size() - 1; ++i) {
+          count += buckets[i];
+          *output << name << "_bucket{" << labels << "le=\""
+                  << family.second.scale * (std::uint64_t(1) << i) << "\"} "
+                  << count << "\n";
+        }
+        count += buckets.back();
+        *output << name << "_bucket{" << labels << "le=\"+Inf\"} " << count
+                << "\n";
+        *output << name << "_sum" << FormatLabels(histogram.first) << " "
+                << family.second.scale * sum << "\n";
+        *output << name << "_count" << FormatLabels(histogram.first) << " "
+                << count << "\n";
+      }
+    } else if (!family.second.gauges.empty()) {
+      *output << "# TYPE " << name << " gauge\n";
+      for (const auto& gauge : family.second.gauges)
+        *output << name << FormatLabels(gauge.first) << " "
+                << gauge.second->Get() << "\n";
+    } else {
+      *output << "# TYPE " << name << " counter\n";
+      for (const auto& counter : family.second.counters)
+        *output << name << FormatLabels(counter.first) << " "
+                << counter.second->Get() << "\n";
+    }
+  }
+}
+
+void MetricsRegistry::WriteTextFile(const FileDescriptor& directory,
+                                    const std::string& name) {
+  std::ostringstream text;
+  WriteText(&text);
+  std::string data = text.str();
+
+  // Write the metrics to a temporary file first, so that the collector
+  // never observes a partially written file.
+  std::string temporary_name = name + ".tmp";
+  int fd = openat(directory.get(), temporary_name.c_str(),
+                  O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::system_error(errno, std::system_category(), temporary_name);
+  FileDescriptor file(fd);
+  for (std::string_view remaining = data; !remaining.empty();) {
+    ssize_t written = write(file.get(), remaining.data(), remaining.size());
+    if (written < 0)
+      throw std::system_error(errno, std::system_category(), temporary_name);
+    remaining.remove_prefix(written);
+  }
+  if (renameat(directory.get(), temporary_name.c_str(), directory.get(),
+               name.c_str()) != 0)
+    throw std::system_error(errno, std::system_category(), name);
+}
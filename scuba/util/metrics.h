@@ -0,0 +1,162 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_METRICS_H
+#define SCUBA_UTIL_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "arpc++/arpc++.h"
+
+namespace scuba {
+namespace util {
+
+// Metrics are spread out over a number of shards, each stored in its
+// own cache line. Threads are assigned to shards in a round-robin
+// fashion, so that threads running on different cores don't contend
+// when updating the same metric.
+constexpr std::size_t kMetricsShards = 16;
+
+inline std::size_t GetMetricsShard() {
+  static std::atomic<std::size_t> next_shard;
+  thread_local std::size_t shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % kMetricsShards;
+  return shard;
+}
+
+// Monotonically increasing counter.
+class Counter {
+ public:
+  Counter() = default;
+
+  void Increment(std::uint64_t amount = 1) {
+    shards_[GetMetricsShard()].value.fetch_add(amount,
+                                               std::memory_order_relaxed);
+  }
+
+  std::uint64_t Get() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> value{0};
+  };
+  std::array<Shard, kMetricsShards> shards_;
+
+  Counter(Counter&) = delete;
+  void operator=(Counter) = delete;
+};
+
+// Value that can go up and down, such as the length of a queue. Unlike
+// counters, gauges are updated rarely enough not to need sharding.
+class Gauge {
+ public:
+  Gauge() = default;
+
+  void Add(std::int64_t amount) {
+    value_.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  std::int64_t Get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<std::int64_t> value_{0};
+
+  Gauge(Gauge&) = delete;
+  void operator=(Gauge) = delete;
+};
+
+// Histogram with bucket boundaries that are powers of two. Bucket i
+// contains the number of observed values that are at most 2^i, but
+// greater than 2^(i-1), matching the inclusive upper bounds that
+// Prometheus uses.
+class Histogram {
+ public:
+  static constexpr std::size_t kBuckets = 40;
+
+  Histogram() = default;
+
+  void Observe(std::uint64_t value) {
+    std::size_t bucket =
+        value <= 1 ? 0
+                   : std::min<std::size_t>(64 - __builtin_clzll(value - 1),
+                                           kBuckets - 1);
+    Shard& shard = shards_[GetMetricsShard()];
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Returns the number of observed values per bucket and their sum.
+  void Get(std::array<std::uint64_t, kBuckets>* buckets,
+           std::uint64_t* sum) const;
+
+ private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets{};
+    std::atomic<std::uint64_t> sum{0};
+  };
+  std::array<Shard, kMetricsShards> shards_;
+
+  Histogram(Histogram&) = delete;
+  void operator=(Histogram) = delete;
+};
+
+// Collection of named metrics that can be exported in the Prometheus
+// text format. Metrics are never removed, meaning that pointers to
+// them may be cached by callers.
+class MetricsRegistry {
+ public:
+  MetricsRegistry() = default;
+
+  // Registry shared by all components of a process.
+  static MetricsRegistry* Default();
+
+  // Labels are provided in their serialized form, e.g. 'code="OK"'.
+  // Values of histograms are multiplied by a scale when exported, so
+  // that they can be observed as integers.
+  Counter* GetCounter(std::string_view name, std::string_view help,
+                      std::string_view labels = {});
+  Gauge* GetGauge(std::string_view name, std::string_view help,
+                  std::string_view labels = {});
+  Histogram* GetHistogram(std::string_view name, std::string_view help,
+                          double scale, std::string_view labels = {});
+
+  void WriteText(std::ostream* output);
+  // Atomically replaces a file in a directory by the current values of
+  // all metrics, for use with Prometheus' textfile collector.
+  void WriteTextFile(const arpc::FileDescriptor& directory,
+                     const std::string& name);
+
+ private:
+  struct Family {
+    std::string help;
+    double scale;
+    std::map<std::string, std::unique_ptr<Counter>, std::less<>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>, std::less<>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>, std::less<>>
+        histograms;
+  };
+
+  std::mutex lock_;
+  std::map<std::string, Family, std::less<>> families_;
+
+  MetricsRegistry(MetricsRegistry&) = delete;
+  void operator=(MetricsRegistry) = delete;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/page_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <optional>
+#include <system_error>
+#include <vector>
+
+using scuba::util::PinnedFile;
+
+namespace scuba {
+namespace util {
+
+void PrefetchFile(int fd) {
+  // Merely advisory, so failures can be ignored.
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+}
+
+std::optional<bool> IsFileCached(int fd) {
+#ifdef __linux__
+  struct stat sb;
+  if (fstat(fd, &sb) != 0)
+    return {};
+  if (sb.st_size == 0)
+    return true;
+  void* data = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    return {};
+  std::size_t page_size = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> pages((sb.st_size + page_size - 1) / page_size);
+  bool cached = mincore(data, sb.st_size, pages.data()) == 0 &&
+                std::all_of(pages.begin(), pages.end(),
+                            [](unsigned char page) { return page & 1; });
+  munmap(data, sb.st_size);
+  return cached;
+#else
+  return {};
+#endif
+}
+
+}  // namespace util
+}  // namespace scuba
+
+PinnedFile::PinnedFile(int fd) : size_(0), data_(nullptr), locked_(false) {
+  struct stat sb;
+  if (fstat(fd, &sb) != 0)
+    throw std::system_error(errno, std::system_category(), "fstat");
+  size_ = sb.st_size;
+  if (size_ == 0)
+    return;
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  data_ = mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+  if (data_ == MAP_FAILED)
+    throw std::system_error(errno, std::system_category(), "mmap");
+
+#if _POSIX_MEMLOCK_RANGE > 0
+  // Locking may fail due to resource limits, in which case the pages
+  // are only populated.
+  locked_ = mlock(data_, size_) == 0;
+#endif
+#ifndef MAP_POPULATE
+  if (!locked_) {
+    std::size_t page_size = sysconf(_SC_PAGESIZE);
+    for (std::size_t offset = 0; offset < size_; offset += page_size)
+      static_cast<const volatile char*>(data_)[offset];
+  }
+#endif
+}
+
+PinnedFile::~PinnedFile() {
+  if (data_ != nullptr)
+    munmap(data_, size_);
+}
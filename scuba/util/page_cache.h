@@ -0,0 +1,51 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_PAGE_CACHE_H
+#define SCUBA_UTIL_PAGE_CACHE_H
+
+#include <cstddef>
+#include <optional>
+
+namespace scuba {
+namespace util {
+
+// Starts reading a file into the page cache in the background, so that
+// processes executing it don't stall on page faults.
+void PrefetchFile(int fd);
+
+// Returns whether all pages of a file are in the page cache, or nothing
+// if this cannot be determined on this system.
+std::optional<bool> IsFileCached(int fd);
+
+// Read-only mapping of a file, whose pages are populated immediately
+// and locked into memory if the system permits. Throws
+// std::system_error if the file cannot be mapped.
+class PinnedFile {
+ public:
+  explicit PinnedFile(int fd);
+  ~PinnedFile();
+
+  std::size_t GetSize() const {
+    return size_;
+  }
+  // Returns whether the pages are locked, as opposed to only having
+  // been populated.
+  bool IsLocked() const {
+    return locked_;
+  }
+
+ private:
+  std::size_t size_;
+  void* data_;
+  bool locked_;
+
+  PinnedFile(PinnedFile&) = delete;
+  void operator=(PinnedFile) = delete;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
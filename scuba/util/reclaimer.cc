@@ -0,0 +1,86 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/reclaimer.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "scuba/util/lock_profiler.h"
+#include "scuba/util/metrics.h"
+
+using scuba::util::Gauge;
+using scuba::util::LockProfiler;
+using scuba::util::MetricsRegistry;
+using scuba::util::Reclaimer;
+
+namespace {
+
+Gauge* const pending_objects = MetricsRegistry::Default()->GetGauge(
+    "scuba_reclaimer_pending_objects",
+    "Number of objects that have been retired, but not yet destroyed.");
+
+}  // namespace
+
+Reclaimer::Reclaimer()
+    : retired_(0),
+      reclaimed_(0),
+      stopping_(false),
+      thread_([this]() { Run_(); }) {
+}
+
+Reclaimer::~Reclaimer() {
+  {
+    std::unique_lock lock(lock_);
+    stopping_ = true;
+    retired_cv_.notify_one();
+  }
+  thread_.join();
+}
+
+Reclaimer* Reclaimer::Default() {
+  static Reclaimer* reclaimer = new Reclaimer();
+  return reclaimer;
+}
+
+void Reclaimer::Retire(std::shared_ptr<void> object) {
+  std::unique_lock lock(lock_);
+  pending_.push_back(std::move(object));
+  ++retired_;
+  pending_objects->Add(1);
+  retired_cv_.notify_one();
+}
+
+void Reclaimer::Drain() {
+  std::unique_lock lock(lock_);
+  std::uint64_t retired = retired_;
+  reclaimed_cv_.wait(lock, [this, retired]() { return reclaimed_ >= retired; });
+}
+
+void Reclaimer::Run_() {
+  LockProfiler::SetOperation("Reclaimer::Run");
+  std::unique_lock lock(lock_);
+  for (;;) {
+    retired_cv_.wait(lock,
+                     [this]() { return !pending_.empty() || stopping_; });
+    if (pending_.empty())
+      return;
+
+    // Destroy objects in batches without holding the lock, so that
+    // retiring objects never has to wait for them.
+    std::vector<std::shared_ptr<void>> batch;
+    batch.swap(pending_);
+    lock.unlock();
+    for (auto& object : batch)
+      object.reset();
+    pending_objects->Add(-std::int64_t(batch.size()));
+    lock.lock();
+    reclaimed_ += batch.size();
+    reclaimed_cv_.notify_all();
+  }
+}
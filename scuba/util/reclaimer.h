@@ -0,0 +1,64 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_RECLAIMER_H
+#define SCUBA_UTIL_RECLAIMER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace scuba {
+namespace util {
+
+// Destroys objects on a background thread. Objects such as pod
+// sandboxes and containers release resources when destroyed that may
+// take a while, like waiting for threads and closing process handles.
+// Retiring them instead of destroying them in place keeps this off the
+// path of requests and out of critical sections.
+//
+// Objects are destroyed in the order in which they are retired, so an
+// object may depend on objects that are retired after it.
+class Reclaimer {
+ public:
+  Reclaimer();
+  ~Reclaimer();
+
+  // Reclaimer shared by all components of a process. It is never
+  // destroyed, as objects may still be retired while the process exits.
+  static Reclaimer* Default();
+
+  template <typename T>
+  void Retire(std::unique_ptr<T> object) {
+    Retire(std::shared_ptr<void>(std::move(object)));
+  }
+  void Retire(std::shared_ptr<void> object);
+
+  // Blocks until all objects retired before the call are destroyed.
+  void Drain();
+
+ private:
+  void Run_();
+
+  std::mutex lock_;
+  std::condition_variable retired_cv_;
+  std::condition_variable reclaimed_cv_;
+  std::vector<std::shared_ptr<void>> pending_;
+  std::uint64_t retired_;
+  std::uint64_t reclaimed_;
+  bool stopping_;
+  std::thread thread_;
+
+  Reclaimer(Reclaimer&) = delete;
+  void operator=(Reclaimer) = delete;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/stream_relay.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace {
+
+// Amount of data moved per system call.
+constexpr std::size_t kChunkSize = 65536;
+
+// Writes all data, returning false if the destination failed.
+bool WriteFully(int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+std::uint64_t CopyStream(int from, int to) {
+  std::uint64_t total = 0;
+  for (;;) {
+    char buffer[kChunkSize];
+    ssize_t length = read(from, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0 || !WriteFully(to, buffer, length))
+      return total;
+    total += length;
+  }
+}
+
+#ifdef SPLICE_F_MOVE
+// Moves data through a pipe, which splice() requires on one end.
+// Returns false if splicing is not supported for these descriptors,
+// in which case nothing has been copied yet.
+bool SpliceStream(int from, int to, std::uint64_t* total) {
+  int pipefds[2];
+  if (pipe2(pipefds, O_CLOEXEC) != 0)
+    return false;
+  bool supported = true;
+  for (;;) {
+    ssize_t length = splice(from, nullptr, pipefds[1], nullptr, kChunkSize,
+                            SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length < 0 && errno == EINVAL && *total == 0)
+      supported = false;
+    if (length <= 0)
+      break;
+    // Drain the pipe completely, so that it is empty when reused.
+    ssize_t remaining = length;
+    while (remaining > 0) {
+      ssize_t moved = splice(pipefds[0], nullptr, to, nullptr, remaining,
+                             SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (moved < 0 && errno == EINTR)
+        continue;
+      if (moved <= 0)
+        break;
+      remaining -= moved;
+    }
+    *total += length - remaining;
+    if (remaining > 0)
+      break;
+  }
+  close(pipefds[0]);
+  close(pipefds[1]);
+  return supported;
+}
+#endif
+
+}  // namespace
+
+namespace scuba {
+namespace util {
+
+std::uint64_t RelayStream(int from, int to) {
+  std::uint64_t total = 0;
+#ifdef SPLICE_F_MOVE
+  if (!SpliceStream(from, to, &total))
+#endif
+    total = CopyStream(from, to);
+  shutdown(to, SHUT_WR);
+  return total;
+}
+
+void RelayStreams(int a, int b) {
+  std::thread reverse([a, b]() { RelayStream(b, a); });
+  RelayStream(a, b);
+  reverse.join();
+}
+
+}  // namespace util
+}  // namespace scuba
@@ -0,0 +1,27 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_STREAM_RELAY_H
+#define SCUBA_UTIL_STREAM_RELAY_H
+
+#include <cstdint>
+
+namespace scuba {
+namespace util {
+
+// Copies data from one stream socket to another until end-of-file is
+// reached, after which the writing side of the destination is shut
+// down. Where supported, data is moved through a pipe using splice(),
+// so that it is never copied into userspace. Returns the number of
+// bytes copied.
+std::uint64_t RelayStream(int from, int to);
+
+// Copies data between two stream sockets in both directions, until
+// both directions have reached end-of-file.
+void RelayStreams(int a, int b);
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,114 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_TIMER_WHEEL_H
+#define SCUBA_UTIL_TIMER_WHEEL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <utility>
+#include <vector>
+
+namespace scuba {
+namespace util {
+
+// Hashed timer wheel. Timers are distributed over a fixed number of
+// slots based on their deadline, making scheduling and cancelling O(1)
+// and advancing the wheel proportional to the number of elapsed ticks,
+// regardless of the number of pending timers.
+template <typename T>
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  class Handle {
+   public:
+    Clock::time_point deadline() const {
+      return timer_->first;
+    }
+
+   private:
+    friend class TimerWheel;
+
+    std::size_t slot_;
+    typename std::list<std::pair<Clock::time_point, T>>::iterator timer_;
+  };
+
+  TimerWheel(Clock::duration tick, std::size_t slots)
+      : tick_(tick), origin_(Clock::now()), current_tick_(0), slots_(slots) {
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  Clock::duration tick() const {
+    return tick_;
+  }
+
+  // Schedules a timer that expires at a given point in time. The handle
+  // remains valid until the timer is cancelled or expires.
+  Handle Schedule(Clock::time_point deadline, T value) {
+    Handle handle;
+    handle.slot_ = std::max(TickOf_(deadline), current_tick_) % slots_.size();
+    auto& slot = slots_[handle.slot_];
+    handle.timer_ = slot.emplace(slot.end(), deadline, std::move(value));
+    ++size_;
+    return handle;
+  }
+
+  void Cancel(const Handle& handle) {
+    slots_[handle.slot_].erase(handle.timer_);
+    --size_;
+  }
+
+  // Removes all timers whose deadline has passed, invoking a callback
+  // for each of them. Timers in slots that are visited, but that are
+  // scheduled for a later round of the wheel are left in place.
+  template <typename Callback>
+  void Advance(Clock::time_point now, Callback callback) {
+    std::uint64_t now_tick = TickOf_(now);
+    std::uint64_t ticks =
+        std::min<std::uint64_t>(now_tick - current_tick_ + 1, slots_.size());
+    std::list<std::pair<Clock::time_point, T>> expired;
+    for (std::uint64_t i = 0; i < ticks; ++i) {
+      auto& slot = slots_[(current_tick_ + i) % slots_.size()];
+      for (auto timer = slot.begin(); timer != slot.end();) {
+        auto next = std::next(timer);
+        if (timer->first <= now)
+          expired.splice(expired.end(), slot, timer);
+        timer = next;
+      }
+    }
+    current_tick_ = now_tick;
+    size_ -= expired.size();
+
+    // Invoke callbacks after updating the wheel, so that they may
+    // schedule and cancel other timers.
+    for (auto& timer : expired)
+      callback(std::move(timer.second));
+  }
+
+ private:
+  std::uint64_t TickOf_(Clock::time_point time) const {
+    return time < origin_ ? 0 : (time - origin_) / tick_;
+  }
+
+  const Clock::duration tick_;
+  const Clock::time_point origin_;
+  std::uint64_t current_tick_;
+  std::size_t size_ = 0;
+  std::vector<std::list<std::pair<Clock::time_point, T>>> slots_;
+
+  TimerWheel(TimerWheel&) = delete;
+  void operator=(TimerWheel) = delete;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "scuba/util/trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using scuba::util::Tracer;
+
+namespace {
+
+// Small sequential identifiers for threads, as the identifiers
+// provided by std::thread can't be converted to integers portably.
+std::uint64_t GetThreadNumber() {
+  static std::atomic<std::uint64_t> next_thread_number(1);
+  thread_local std::uint64_t thread_number = next_thread_number++;
+  return thread_number;
+}
+
+void WriteJSONString(std::ostream* output, std::string_view str) {
+  *output << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      *output << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      *output << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+              << int(c) << std::dec;
+    } else {
+      *output << c;
+    }
+  }
+  *output << '"';
+}
+
+// Chrome expects timestamps in microseconds. Print them with fractional
+// digits, as plain floating point formatting would lose precision.
+void WriteMicroseconds(std::ostream* output, std::chrono::nanoseconds time) {
+  *output << time.count() / 1000 << '.' << std::setw(3) << std::setfill('0')
+          << time.count() % 1000;
+}
+
+}  // namespace
+
+Tracer::Tracer(std::size_t capacity)
+    : origin_(Clock::now()), enabled_(false), next_span_(0) {
+  spans_.reserve(capacity);
+}
+
+Tracer* Tracer::Default() {
+  static Tracer tracer(65536);
+  return &tracer;
+}
+
+void Tracer::SetEnabled(bool enabled) {
+  std::unique_lock lock(lock_);
+  if (enabled && !enabled_) {
+    spans_.clear();
+    next_span_ = 0;
+  }
+  enabled_ = enabled;
+}
+
+void Tracer::Record(const char* name, std::string detail,
+                    Clock::time_point start, Clock::time_point end) {
+  Span span{name, std::move(detail), GetThreadNumber(), start, end};
+  std::unique_lock lock(lock_);
+  if (spans_.size() < spans_.capacity())
+    spans_.push_back(std::move(span));
+  else
+    spans_[next_span_] = std::move(span);
+  next_span_ = (next_span_ + 1) % spans_.capacity();
+}
+
+void Tracer::WriteChromeTrace(std::ostream* output) {
+  std::unique_lock lock(lock_);
+  *output << "{\"traceEvents\":[";
+  for (std::size_t i = 0; i < spans_.size(); ++i) {
+    // Write spans from oldest to newest.
+    const Span& span =
+        spans_.size() < spans_.capacity()
+            ? spans_[i]
+            : spans_[(next_span_ + i) % spans_.size()];
+    if (i > 0)
+      *output << ',';
+    *output << "{\"name\":";
+    WriteJSONString(output, span.name);
+    *output << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread
+            << ",\"ts\":";
+    WriteMicroseconds(output, span.start - origin_);
+    *output << ",\"dur\":";
+    WriteMicroseconds(output, span.end - span.start);
+    if (!span.detail.empty()) {
+      *output << ",\"args\":{\"detail\":";
+      WriteJSONString(output, span.detail);
+      *output << '}';
+    }
+    *output << '}';
+  }
+  *output << "]}";
+}
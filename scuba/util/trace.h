@@ -0,0 +1,109 @@
+// Copyright (c) 2017 Nuxi, https://nuxi.nl/
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef SCUBA_UTIL_TRACE_H
+#define SCUBA_UTIL_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace scuba {
+namespace util {
+
+// Recorder of spans of time spent in phases of operations. Completed
+// spans are stored in a ring buffer of fixed size, from which they can
+// be exported in Chrome's trace event format.
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Tracer(std::size_t capacity);
+
+  // Tracer shared by all components of a process.
+  static Tracer* Default();
+
+  bool IsEnabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Enables or disables tracing. Enabling tracing discards all spans
+  // recorded previously.
+  void SetEnabled(bool enabled);
+
+  void Record(const char* name, std::string detail, Clock::time_point start,
+              Clock::time_point end);
+  void WriteChromeTrace(std::ostream* output);
+
+ private:
+  struct Span {
+    const char* name;
+    std::string detail;
+    std::uint64_t thread;
+    Clock::time_point start;
+    Clock::time_point end;
+  };
+
+  const Clock::time_point origin_;
+  std::atomic<bool> enabled_;
+
+  std::mutex lock_;
+  std::vector<Span> spans_;
+  std::size_t next_span_;
+
+  Tracer(Tracer&) = delete;
+  void operator=(Tracer) = delete;
+};
+
+// Span that is recorded when it ends or goes out of scope. When tracing
+// is disabled, creating a span only consists of checking whether it is
+// enabled. Details are provided through a function, so that they are
+// only computed when tracing is enabled.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name) : TraceSpan(name, []() { return ""; }) {
+  }
+
+  template <typename DetailFunction>
+  TraceSpan(const char* name, DetailFunction detail) : name_(name) {
+    Tracer* tracer = Tracer::Default();
+    if (tracer->IsEnabled()) {
+      tracer_ = tracer;
+      detail_ = detail();
+      start_ = Tracer::Clock::now();
+    } else {
+      tracer_ = nullptr;
+    }
+  }
+
+  ~TraceSpan() {
+    End();
+  }
+
+  void End() {
+    if (tracer_ != nullptr) {
+      tracer_->Record(name_, std::move(detail_), start_,
+                      Tracer::Clock::now());
+      tracer_ = nullptr;
+    }
+  }
+
+ private:
+  const char* const name_;
+  Tracer* tracer_;
+  std::string detail_;
+  Tracer::Clock::time_point start_;
+
+  TraceSpan(TraceSpan&) = delete;
+  void operator=(TraceSpan) = delete;
+};
+
+}  // namespace util
+}  // namespace scuba
+
+#endif